@@ -1,22 +1,134 @@
 #pragma once
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <array>
+#include <bit>
 #include <memory>
 #include <atomic>
 #include <vector>
+#include <deque>
+#include <functional>
 #include <algorithm>
 #include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
 
 inline void waste_time(std::size_t n){
     std::size_t s_i = 0;
     volatile std::size_t * sum_i = &s_i;
     for(std::size_t j = 0; j < n; j++){
-        *sum_i += j;
+        *sum_i = *sum_i + j;
     }
 }
 
+// cpu_relax tells the core we are in a spin loop.
+inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
 using handle_t = std::size_t;
-enum WorkerState {heapTop, recentPush, both, neither};
+
+// DupTag is a worker's verdict on a speculated child from its probe of the
+// closed list, see SharedClosedList.
+enum DupTag : std::uint8_t{
+    dd_unknown,  // not probed, the main thread expanded it
+    dd_new,      // no entry for the state
+    dd_worse,    // an entry with g no worse than the child's
+    dd_better,   // an entry the child improves on
+};
+
+// ReservedArray reserves address space for capacity elements up front and
+// commits it a chunk at a time as the array is used, so a large capacity
+// costs nothing until it is touched and the array never moves.
+template <typename T>
+class ReservedArray{
+    private:
+        static constexpr std::size_t commit_bytes = 1 << 20;  // commit granularity
+
+        T * _data;
+        std::size_t _capacity;   // elements reserved
+        std::size_t _committed;  // elements usable
+        std::size_t _reserved_bytes;
+
+        static std::size_t page_size(){
+            static const std::size_t sz = sysconf(_SC_PAGESIZE);
+            return sz;
+        }
+
+        bool commit(std::size_t n){
+            std::size_t bytes = std::max(n * sizeof(T), _committed * sizeof(T) + commit_bytes);
+            bytes = std::min((bytes + page_size() - 1) / page_size() * page_size(), _reserved_bytes);
+            if(mprotect(_data, bytes, PROT_READ | PROT_WRITE) != 0){
+                return false;
+            }
+            _committed = std::min(bytes / sizeof(T), _capacity);
+            return _committed >= n;
+        }
+
+    public:
+        ReservedArray(std::size_t capacity):_data(nullptr),_capacity(capacity),_committed(0){
+            _reserved_bytes = (std::max<std::size_t>(capacity, 1) * sizeof(T) + page_size() - 1) / page_size() * page_size();
+            void * p = mmap(nullptr, _reserved_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(p == MAP_FAILED){
+                std::cerr << "Error bad mmap of " << _reserved_bytes << " bytes\n";
+                exit(-1);
+            }
+            _data = static_cast<T *>(p);
+        }
+
+        ReservedArray(ReservedArray&& o) noexcept:_data(o._data),_capacity(o._capacity),_committed(o._committed),_reserved_bytes(o._reserved_bytes){
+            o._data = nullptr;
+        }
+
+        ReservedArray(const ReservedArray&) = delete;
+        ReservedArray& operator=(const ReservedArray&) = delete;
+
+        ~ReservedArray(){
+            if(_data != nullptr){
+                munmap(_data, _reserved_bytes);
+            }
+        }
+
+        // ensure makes the first n elements usable.  It throws
+        // std::bad_alloc if n is past the reservation.
+        inline void ensure(std::size_t n){
+            if(n > _committed && (n > _capacity || !commit(n))){
+                throw std::bad_alloc();
+            }
+        }
+
+        // prefault commits and writes the first n elements' pages from
+        // the calling thread, so a first-touch NUMA policy puts them on
+        // that thread's node.
+        inline void prefault(std::size_t n){
+            n = std::min(n, _capacity);
+            ensure(n);
+            volatile char * p = reinterpret_cast<volatile char *>(_data);
+            for(std::size_t b = 0; b < n * sizeof(T); b += page_size()){
+                p[b] = p[b];  // a write, so the page is allocated here
+            }
+        }
+
+        inline T * data() const{
+            return _data;
+        }
+
+        inline std::size_t capacity() const{
+            return _capacity;
+        }
+
+        inline std::size_t committed() const{
+            return _committed;
+        }
+};
+enum WorkerState {heapTop, recentPush, both, neither, nested};  // nested: expanded with its parent
 
 struct ExpansionEntry{
     WorkerState state;
@@ -26,9 +138,47 @@ struct ExpansionEntry{
     ExpansionEntry(WorkerState ws, std::size_t i):state(ws),queue_depth(static_cast<unsigned int>(i)){}
 };
 
+// LogHistogram counts values in power of two buckets: bucket 0 holds 0
+// and bucket i holds [2^(i-1), 2^i).
+struct LogHistogram{
+    static constexpr std::size_t n_buckets = 33;
+    std::array<std::size_t, n_buckets> buckets{};
+
+    inline void add(std::uint32_t v){
+        buckets[std::bit_width(v)]++;
+    }
+
+    inline void add(const LogHistogram& other){
+        for(std::size_t i = 0; i < n_buckets; i++){
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    inline std::size_t total() const{
+        std::size_t retval = 0;
+        for(auto b : buckets){
+            retval += b;
+        }
+        return retval;
+    }
+
+    static inline std::size_t lower(std::size_t i){
+        return i == 0 ? 0 : std::size_t(1) << (i - 1);
+    }
+
+    static inline std::size_t upper(std::size_t i){
+        return std::size_t(1) << i;
+    }
+};
+
 struct WorkerMetadata{
     std::vector<std::size_t> heap_top_fetch;
     std::vector<std::size_t> recent_push_fetch;
+    LogHistogram delays;  // expansions between generation and speculation, when enabled
+    std::size_t parks = 0;       // times the worker went to sleep for lack of work
+    double parked_seconds = 0;   // total time spent asleep
+    std::size_t nested = 0;      // children expanded along with their parent
+    bool pool_full = false;      // the worker stopped for good, its NodePool ran out
 
     WorkerMetadata() = default;
     
@@ -39,6 +189,11 @@ struct WorkerMetadata{
          for(std::size_t i = 0; i < recent_push_fetch.size(); i++){
             recent_push_fetch[i] += other.recent_push_fetch[i];
         }
+        delays.add(other.delays);
+        parks += other.parks;
+        parked_seconds += other.parked_seconds;
+        nested += other.nested;
+        pool_full = pool_full || other.pool_full;
     }
 
     inline void add(const ExpansionEntry& ee){
@@ -89,13 +244,33 @@ template <typename Node_t, typename Compare>
 struct HeapNode{
     private: 
         std::atomic<HeapNode<Node_t, Compare> *> precomputed_successors;  // array of precomputed successors
-        std::size_t n_precomputed_successors;
+        std::uint32_t n_precomputed_successors;
+    public:
+        std::uint32_t born;  // main thread expansion count when generated, only kept with -hist
+    private:
         std::atomic<bool> reserved;
         // std::atomic<bool> spoiled;
+
+        static inline char abandoned_tag;
+        static inline HeapNode<Node_t, Compare> * abandoned(){  // marks a node the main thread has claimed
+            return reinterpret_cast<HeapNode<Node_t, Compare> *>(&abandoned_tag);
+        }
     public:
+        // Block bookkeeping for NodePool, it fits in the padding after reserved.
+        // block_len, block_live and owner are only meaningful on the first node of a block.
+        std::uint8_t block_ofs;    // index of this node in its block
+        std::uint8_t block_len;    // number of nodes in the block
+        std::uint8_t block_live;   // nodes of the block still referenced by the search (main thread only)
+        std::uint16_t owner;       // id of the NodePool the block came from
+        DupTag dup_tag;            // set when the node is generated
         Node_t search_node;  // the usual search node: {state, g, f, parent...}
-        handle_t handle;
+        union{
+            handle_t handle;
+            HeapNode<Node_t, Compare> * next_free;  // free list link once the block is dead
+        };
         ExpansionEntry ee;
+        std::uint32_t hash;    // SharedClosedList hash of the state
+        std::uint32_t probed;  // closed list version dup_tag was computed at
         
         constexpr HeapNode(){};
 
@@ -125,14 +300,13 @@ struct HeapNode{
 
         // }
 
-        inline void set_completed(HeapNode<Node_t, Compare> * pre_array, std::size_t n){ // Worker thread only
+        // set_completed publishes a worker's successors.  It returns false if
+        // the main thread claimed the node first, the worker still owns pre_array then.
+        inline bool set_completed(HeapNode<Node_t, Compare> * pre_array, std::size_t n){ // Worker thread only
             n_precomputed_successors = n;
-            precomputed_successors.store(pre_array, std::memory_order_release);
+            HeapNode<Node_t, Compare> * expected = nullptr;
+            return precomputed_successors.compare_exchange_strong(expected, pre_array, std::memory_order_release, std::memory_order_relaxed);
             // std::cerr << "Set complete: " << *this << "\n";
-            // if(spoiled.load(std::memory_order_relaxed)){
-            //     n_precomputed_successors = 0;
-            //     precomputed_successors.store(nullptr, std::memory_order_release);
-            // }
         }
 
          inline void set_completed(void * pre_array, std::size_t n){ // dummy, do not use
@@ -141,7 +315,8 @@ struct HeapNode{
         }
 
         inline bool is_completed() const{ // For main thread only
-            return precomputed_successors.load(std::memory_order_acquire) != nullptr;
+            auto p = precomputed_successors.load(std::memory_order_acquire);
+            return p != nullptr && p != abandoned();
         }
 
         inline std::pair<HeapNode<Node_t, Compare> *, std::size_t> get_successors() const{ // main thread only, check is_completed first
@@ -149,6 +324,17 @@ struct HeapNode{
             return std::make_pair(precomputed_successors.load(std::memory_order_acquire), n_precomputed_successors);
         }
 
+        // claim takes the node away from the workers.  It returns the precomputed
+        // successors if a worker finished first, otherwise {nullptr, 0} and any
+        // later set_completed fails.
+        inline std::pair<HeapNode<Node_t, Compare> *, std::size_t> claim(){ // main thread only
+            auto p = precomputed_successors.exchange(abandoned(), std::memory_order_acq_rel);
+            if(p == nullptr || p == abandoned()){
+                return std::make_pair(nullptr, 0);
+            }
+            return std::make_pair(p, n_precomputed_successors);
+        }
+
         // inline void mark_fresh(){
         //     spoiled = false;
         //     spoiled.store(false, std::memory_order_relaxed);
@@ -171,32 +357,328 @@ struct HeapNode{
 };
 
 template <typename Node_t, typename Compare>
-class NodePool{ // NOT THREAD SAFE ONE PER THREAD
+class NodePool{ // NOT THREAD SAFE ONE PER THREAD, except give_back
     private:
+        ReservedArray<HeapNode<Node_t, Compare>> _storage;
         HeapNode<Node_t, Compare> * _nodes;
-        const std::size_t _capacity;
         std::size_t _size;
-    public:
-        NodePool(std::size_t capacity):_capacity(capacity),_size(0){
-            _nodes = reinterpret_cast<HeapNode<Node_t, Compare> *>(std::malloc(capacity * sizeof(HeapNode<Node_t, Compare>)));
-            if(_nodes == nullptr){
-                std::cerr << "Error bad malloc\n";
-                exit(-1);
+        const std::uint16_t _id;
+        std::vector<HeapNode<Node_t, Compare> *> _free;  // dead blocks by length
+        std::atomic<HeapNode<Node_t, Compare> *> _returned;  // dead blocks from other threads
+        std::size_t _reused;
+
+        inline void take_returned(){
+            auto b = _returned.exchange(nullptr, std::memory_order_acquire);
+            while(b != nullptr){
+                auto nxt = b->next_free;
+                release(b);
+                b = nxt;
             }
         }
 
-        ~NodePool(){
-            free(_nodes);
-        }
+    public:
+        NodePool(std::size_t capacity, std::uint16_t id = 0):_storage(capacity),_nodes(_storage.data()),_size(0),_id(id),_returned(nullptr),_reused(0){}
 
+        NodePool(NodePool&& o) noexcept:_storage(std::move(o._storage)),_nodes(o._nodes),_size(o._size),_id(o._id),_free(std::move(o._free)),_returned(o._returned.load()),_reused(o._reused){}
+
+        // reserve returns a block of n nodes, reusing a dead block of the
+        // same length when one is available.  It throws std::bad_alloc once
+        // the pool's capacity is used up.
         HeapNode<Node_t, Compare> * reserve(std::size_t n){
-            assert(_size + n <= _capacity);
-            HeapNode<Node_t, Compare> * retval = _nodes + _size;
-            _size += n;
+            if(n == 0){
+                return _nodes + _size;
+            }
+            assert(n <= std::numeric_limits<std::uint8_t>::max());
+            if((n >= _free.size() || _free[n] == nullptr) && _returned.load(std::memory_order_relaxed) != nullptr){
+                take_returned();
+            }
+            HeapNode<Node_t, Compare> * retval;
+            if(n < _free.size() && _free[n] != nullptr){
+                retval = _free[n];
+                _free[n] = retval->next_free;
+                _reused++;
+            }
+            else{
+                _storage.ensure(_size + n);
+                retval = _nodes + _size;
+                _size += n;
+            }
+            for(std::size_t i = 0; i < n; i++){
+                retval[i].block_ofs = static_cast<std::uint8_t>(i);
+            }
+            retval->block_len = static_cast<std::uint8_t>(n);
+            retval->block_live = static_cast<std::uint8_t>(n);
+            retval->owner = _id;
             return retval;
-        } 
+        }
 
-        /* TODO: Create Destruct Function */
+        // release puts a dead block back on this pool's free list, owner thread only.
+        void release(HeapNode<Node_t, Compare> * block){
+            assert(block->owner == _id);
+            std::size_t n = block->block_len;
+            if(_free.size() <= n){
+                _free.resize(n + 1, nullptr);
+            }
+            block->next_free = _free[n];
+            _free[n] = block;
+        }
+
+        // give_back hands a dead block back from another thread, the
+        // owner picks it up on its next reserve.
+        void give_back(HeapNode<Node_t, Compare> * block){
+            auto head = _returned.load(std::memory_order_relaxed);
+            do{
+                block->next_free = head;
+            }while(!_returned.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        // prefault touches the start of the pool from the calling
+        // thread, call it from the owner once it is placed.
+        void prefault(std::size_t n){
+            _storage.prefault(n);
+        }
+
+        std::uint16_t id() const{
+            return _id;
+        }
+
+        // Number of nodes ever carved from the pool, the high water mark.
+        std::size_t size() const{
+            return _size;
+        }
+
+        // Number of blocks handed out from the free lists.
+        std::size_t reused() const{
+            return _reused;
+        }
+};
+
+// EpochReclaimer decides when a block the main thread has dropped can be
+// reused.  pools[i] must have id i and pools[0] belongs to the main thread.  Workers pin the current epoch while they hold pointers taken
+// from the speculation windows; a block retired in epoch e is handed back
+// to its pool once every pinned worker has moved past e.  Retired nodes
+// must already be unreachable from the windows (see CafeMinBinaryHeap::forget).
+template <typename Node_t, typename Compare>
+class EpochReclaimer{
+    private:
+        static constexpr std::uint64_t quiescent = std::numeric_limits<std::uint64_t>::max();
+
+        struct alignas(64) Announce{
+            std::atomic<std::uint64_t> epoch{quiescent};
+        };
+
+        std::atomic<std::uint64_t> _epoch;
+        std::unique_ptr<Announce[]> _announce;
+        std::size_t _n_workers;
+        std::deque<std::pair<std::uint64_t, HeapNode<Node_t, Compare> *>> _limbo;  // main thread only
+        std::deque<std::pair<std::uint64_t, std::function<void()>>> _deferred;  // main thread only
+        std::size_t _reclaimed;
+
+    public:
+        EpochReclaimer(std::size_t n_workers):_epoch(0),_announce(new Announce[n_workers]),_n_workers(n_workers),_reclaimed(0){}
+
+        inline void pin(std::size_t worker){  // worker thread only
+            _announce[worker].epoch.store(_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        inline void unpin(std::size_t worker){  // worker thread only
+            _announce[worker].epoch.store(quiescent, std::memory_order_release);
+        }
+
+        inline void retire(HeapNode<Node_t, Compare> * block){  // main thread only
+            _limbo.emplace_back(_epoch.load(std::memory_order_relaxed), block);
+        }
+
+        // defer runs free once no pinned worker can still see what it frees.
+        inline void defer(std::function<void()> free){  // main thread only
+            _deferred.emplace_back(_epoch.load(std::memory_order_relaxed), std::move(free));
+        }
+
+        // collect starts a new epoch and returns every block that no pinned
+        // worker can still see to its pool.
+        inline void collect(std::vector<NodePool<Node_t, Compare>>& pools){  // main thread only
+            _epoch.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::uint64_t oldest = quiescent;
+            for(std::size_t i = 0; i < _n_workers; i++){
+                oldest = std::min(oldest, _announce[i].epoch.load(std::memory_order_acquire));
+            }
+            while(!_limbo.empty() && _limbo.front().first < oldest){
+                auto block = _limbo.front().second;
+                _limbo.pop_front();
+                auto& pool = pools[block->owner];
+                if(block->owner == 0){  // the main thread's own pool
+                    pool.release(block);
+                }
+                else{
+                    pool.give_back(block);
+                }
+                _reclaimed++;
+            }
+            while(!_deferred.empty() && _deferred.front().first < oldest){
+                _deferred.front().second();
+                _deferred.pop_front();
+            }
+        }
+
+        inline std::size_t reclaimed() const{
+            return _reclaimed;
+        }
+
+        inline std::size_t pending() const{
+            return _limbo.size();
+        }
+};
+
+// SharedClosedList is CAFE's closed list, an open addressing table of
+// HeapNode pointers keyed by their state.  The main thread is the only
+// writer; workers may find() concurrently while pinned in the reclaimer,
+// which keeps a table replaced by a resize alive until they let go.
+// Every write stamps one of the table's stripes with a new version, so a
+// probe made at version v still holds for a state whose stripe has not
+// been stamped after v.  Entries are never removed and only ever replaced
+// by nodes with a smaller g, so a dd_worse verdict never goes stale.
+template <typename Node_t, typename Compare, typename Eq>
+class SharedClosedList{
+    private:
+        using Node = HeapNode<Node_t, Compare>;
+        static constexpr unsigned int stripe_bits = 16;
+
+        struct Slot{
+            std::atomic<std::uint32_t> hash{0};
+            std::atomic<Node *> node{nullptr};
+        };
+
+        struct Table{
+            std::size_t mask;
+            std::unique_ptr<Slot[]> slots;
+            Table(std::size_t n):mask(n-1),slots(new Slot[n]){}
+        };
+
+        EpochReclaimer<Node_t, Compare>& _reclaimer;
+        std::atomic<Table *> _table;
+        std::size_t _fill;
+        std::atomic<std::uint32_t> _version;
+        std::vector<std::uint32_t> _stamps;  // main thread only
+
+        static inline std::uint64_t mix(std::uint32_t h){
+            return std::uint64_t(h) * 0x9E3779B97F4A7C15ull;
+        }
+
+        static inline std::size_t stripe(std::uint32_t h){
+            return mix(h) >> (64 - stripe_bits);
+        }
+
+        static inline Node * lookup(const Table& t, const Node * key, std::uint32_t h, std::size_t& i){
+            for(i = (mix(h) >> 32) & t.mask;; i = (i + 1) & t.mask){
+                Node * n = t.slots[i].node.load(std::memory_order_acquire);
+                if(n == nullptr){
+                    return nullptr;
+                }
+                if(t.slots[i].hash.load(std::memory_order_relaxed) == h && Eq()(n->search_node, key->search_node)){
+                    return n;
+                }
+            }
+        }
+
+        inline void stamp(std::uint32_t h){
+            std::uint32_t v = _version.load(std::memory_order_relaxed) + 1;
+            _stamps[stripe(h)] = v;
+            _version.store(v, std::memory_order_release);  // after the slot write
+        }
+
+        void grow(){
+            Table * old = _table.load(std::memory_order_relaxed);
+            Table * t = new Table(2 * (old->mask + 1));
+            for(std::size_t i = 0; i <= old->mask; i++){
+                Node * n = old->slots[i].node.load(std::memory_order_relaxed);
+                if(n == nullptr){
+                    continue;
+                }
+                std::uint32_t h = old->slots[i].hash.load(std::memory_order_relaxed);
+                std::size_t j = (mix(h) >> 32) & t->mask;
+                while(t->slots[j].node.load(std::memory_order_relaxed) != nullptr){
+                    j = (j + 1) & t->mask;
+                }
+                t->slots[j].hash.store(h, std::memory_order_relaxed);
+                t->slots[j].node.store(n, std::memory_order_relaxed);
+            }
+            _table.store(t, std::memory_order_release);
+            _reclaimer.defer([old](){ delete old; });
+        }
+
+    public:
+        SharedClosedList(EpochReclaimer<Node_t, Compare>& reclaimer, std::size_t capacity = 1024):
+            _reclaimer(reclaimer),_table(new Table(std::bit_ceil(std::max<std::size_t>(capacity, 2)))),_fill(0),_version(0),_stamps(std::size_t(1) << stripe_bits, 0){}
+
+        ~SharedClosedList(){
+            delete _table.load();
+        }
+
+        // fold reduces a domain hash to the 32 bits kept in HeapNode.
+        static inline std::uint32_t fold(unsigned long h){
+            return static_cast<std::uint32_t>(h ^ (static_cast<std::uint64_t>(h) >> 32));
+        }
+
+        // find returns the entry for key's state or nullptr, any thread.
+        inline Node * find(const Node * key, std::uint32_t h) const{
+            std::size_t i;
+            return lookup(*_table.load(std::memory_order_acquire), key, h, i);
+        }
+
+        // version is the write count, read it before probing.
+        inline std::uint32_t version() const{
+            return _version.load(std::memory_order_acquire);
+        }
+
+        // unchanged_since tells if no write since version v can have touched
+        // the entry for a state with hash h.  Main thread only.
+        inline bool unchanged_since(std::uint32_t h, std::uint32_t v) const{
+            return static_cast<std::int32_t>(_stamps[stripe(h)] - v) <= 0;
+        }
+
+        // insert adds n, whose state must not be in the table yet.
+        void insert(Node * n){  // main thread only
+            Table * t = _table.load(std::memory_order_relaxed);
+            if(4 * (_fill + 1) > 3 * (t->mask + 1)){
+                grow();
+                t = _table.load(std::memory_order_relaxed);
+            }
+            std::size_t i = (mix(n->hash) >> 32) & t->mask;
+            while(t->slots[i].node.load(std::memory_order_relaxed) != nullptr){
+                i = (i + 1) & t->mask;
+            }
+            t->slots[i].hash.store(n->hash, std::memory_order_relaxed);
+            t->slots[i].node.store(n, std::memory_order_release);
+            _fill++;
+            stamp(n->hash);
+        }
+
+        // assign makes n the entry for its state.
+        void assign(Node * n){  // main thread only
+            Table * t = _table.load(std::memory_order_relaxed);
+            std::size_t i;
+            if(lookup(*t, n, n->hash, i) == nullptr){
+                insert(n);
+                return;
+            }
+            t->slots[i].node.store(n, std::memory_order_release);
+            stamp(n->hash);
+        }
+
+        std::size_t size() const{
+            return _fill;
+        }
+
+        // clear empties the table, no worker may be running.
+        void clear(){
+            Table * t = _table.load(std::memory_order_relaxed);
+            for(std::size_t i = 0; i <= t->mask; i++){
+                t->slots[i].node.store(nullptr, std::memory_order_relaxed);
+            }
+            _fill = 0;
+        }
 };
 
 constexpr handle_t parent(handle_t i){
@@ -214,17 +696,37 @@ constexpr handle_t right_child(handle_t i){
     return 2*i + 2;
 }
 
+// CafeWindows holds the speculation windows that CAFE workers fetch work
+// from: a copy of the nodes just below the top of the open list and a ring
+// of the most recently generated nodes.  The open list heaps derive from it
+// and refresh the windows from their pop and batch_recent_push.
 template <typename Node_t, typename Compare>
-class CafeMinBinaryHeap{
-    private:
-        std::size_t _capacity;  // size of array
-        std::size_t size;       // size of heap 
-        const unsigned int recent_queue_size; // size of helper queues
-        const unsigned int top_queue_size; // size of helper queues
-        HeapNode<Node_t, Compare>* * _data; // of atomic pointers to nodes
+class CafeWindows{
+    protected:
+        const unsigned int recent_queue_capacity; // allocated size of helper queues
+        const unsigned int top_queue_capacity;
+        std::atomic<unsigned int> recent_queue_size; // size of helper queues in use, the rest are nullptr
+        std::atomic<unsigned int> top_queue_size;
         HeapNode<Node_t, Compare>* * _heap_top;
         HeapNode<Node_t, Compare>* * _recent_push;
         unsigned int _recent_push_index;
+        std::atomic<std::uint32_t> _work_seq;  // bumped whenever the windows change
+        std::atomic<unsigned int> _parked;     // workers that went to sleep since the last wakeup
+        std::atomic<bool> _stopping;           // set by wake_all, parked workers stay awake
+        std::size_t _wakeups;
+
+        // publish_work tells parked workers the windows have changed.  The
+        // parked count is cleared on wakeup, so the main thread only pays
+        // for a notify once per round of workers going to sleep.
+        inline void publish_work(){
+            _work_seq.fetch_add(1, std::memory_order_seq_cst);
+            // seq_cst pairs with park: either this sees the worker's
+            // count or the worker's wait sees the new sequence number.
+            if(_parked.load(std::memory_order_seq_cst) > 0 && _parked.exchange(0, std::memory_order_seq_cst) > 0){
+                _work_seq.notify_all();
+                _wakeups++;
+            }
+        }
 
         inline unsigned int rnv(unsigned int i, unsigned int queue_size) const{
             return i % queue_size;
@@ -232,11 +734,199 @@ class CafeMinBinaryHeap{
         }
 
         inline unsigned int recent_next_index(){
-            unsigned int retval = rnv(_recent_push_index+1, recent_queue_size);
+            unsigned int retval = rnv(_recent_push_index+1, recent_queue_size.load(std::memory_order_relaxed));
             _recent_push_index = retval;
             return retval;
         }
 
+        inline void setWorkerTop(){
+            workerState.store(WorkerState::heapTop, std::memory_order_release);
+        }
+
+        inline void setWorkerRecent(){
+            workerState.store(WorkerState::recentPush, std::memory_order_release);
+        }
+
+        inline void setWorkerBoth(){
+            workerState.store(WorkerState::both, std::memory_order_release);
+        }
+
+        inline void push_recent(HeapNode<Node_t, Compare> * n){
+            assert(workerState == WorkerState::heapTop || workerState == WorkerState::neither);
+            assert(n != nullptr);
+            _recent_push[recent_next_index()] = n;
+        }
+
+    public:
+        std::atomic<WorkerState> workerState;
+
+        inline CafeWindows(std::size_t recent_queue_capacity, std::size_t top_queue_capacity):recent_queue_capacity(recent_queue_capacity),top_queue_capacity(top_queue_capacity),recent_queue_size(recent_queue_capacity),top_queue_size(top_queue_capacity),_recent_push_index(0),_work_seq(0),_parked(0),_stopping(false),_wakeups(0),workerState(WorkerState::neither){
+            _heap_top = new HeapNode<Node_t, Compare>*[top_queue_capacity];
+            _recent_push = new HeapNode<Node_t, Compare>*[recent_queue_capacity];
+            for(std::size_t i = 0; i < top_queue_capacity; i++){
+                _heap_top[i] = nullptr;
+            }
+            for(std::size_t i = 0; i < recent_queue_capacity; i++){
+                _recent_push[i] = nullptr;
+            }
+        }
+
+        CafeWindows(const CafeWindows&) = delete;
+        CafeWindows& operator=(const CafeWindows&) = delete;
+
+        inline ~CafeWindows(){
+            delete[] _heap_top;
+            delete[] _recent_push;
+        }
+
+        inline void batch_recent_push(HeapNode<Node_t, Compare> * nodes, const unsigned int nodes_size){
+            setWorkerTop();
+            const unsigned int n = std::min(nodes_size, recent_queue_size.load(std::memory_order_relaxed));
+            for(unsigned int i = 0; i < n; i++){
+                push_recent(&nodes[i]);  // zeroed when generated, may hold nested successors
+            }
+            setWorkerBoth();
+            publish_work();
+        }
+
+        // work_seq is read by a worker before it looks for work; park
+        // sleeps until the windows change after that read.
+        inline std::uint32_t work_seq() const{ // for worker
+            return _work_seq.load(std::memory_order_acquire);
+        }
+
+        // park does not sleep once wake_all has been called, so a
+        // worker that read seen after the final wakeup cannot miss it.
+        inline void park(std::uint32_t seen){ // for worker
+            _parked.fetch_add(1, std::memory_order_seq_cst);
+            while(!_stopping.load(std::memory_order_seq_cst) && _work_seq.load(std::memory_order_seq_cst) == seen)
+                _work_seq.wait(seen, std::memory_order_seq_cst);
+        }
+
+        // wake_all wakes every parked worker so they can see a stop
+        // request, and keeps them from parking again until unstop.
+        inline void wake_all(){
+            _stopping.store(true, std::memory_order_seq_cst);
+            _work_seq.fetch_add(1, std::memory_order_seq_cst);
+            _work_seq.notify_all();
+        }
+
+        // unstop lets workers park again, before a new search starts
+        // them.
+        inline void unstop(){
+            _stopping.store(false, std::memory_order_seq_cst);
+        }
+
+        // Number of times pop or batch_recent_push had to wake parked workers.
+        inline std::size_t wakeups() const{
+            return _wakeups;
+        }
+
+        // forget drops a node from the speculation windows so that no
+        // worker can fetch it after it is retired.
+        inline void forget(const HeapNode<Node_t, Compare> * node){ // MAIN THREAD ONLY
+            const unsigned int top_size = top_queue_size.load(std::memory_order_relaxed);
+            const unsigned int recent_size = recent_queue_size.load(std::memory_order_relaxed);
+            for(unsigned int i = 0; i < top_size; i++){
+                if(_heap_top[i] == node){
+                    _heap_top[i] = nullptr;
+                }
+            }
+            for(unsigned int i = 0; i < recent_size; i++){
+                if(_recent_push[i] == node){
+                    _recent_push[i] = nullptr;
+                }
+            }
+        }
+
+        // resize_windows changes how much of each speculation window the
+        // workers look at, clamped to [1, capacity].  Slots past the new
+        // sizes are cleared so they never hold a stale pointer.
+        inline void resize_windows(unsigned int top, unsigned int recent){ // MAIN THREAD ONLY
+            top = std::clamp(top, 1u, top_queue_capacity);
+            recent = std::clamp(recent, 1u, recent_queue_capacity);
+            top_queue_size.store(top, std::memory_order_relaxed);
+            recent_queue_size.store(recent, std::memory_order_relaxed);
+            for(unsigned int i = top; i < top_queue_capacity; i++){
+                _heap_top[i] = nullptr;
+            }
+            for(unsigned int i = recent; i < recent_queue_capacity; i++){
+                _recent_push[i] = nullptr;
+            }
+            _recent_push_index %= recent;
+        }
+
+        inline unsigned int top_window() const{
+            return top_queue_size.load(std::memory_order_relaxed);
+        }
+
+        inline unsigned int recent_window() const{
+            return recent_queue_size.load(std::memory_order_relaxed);
+        }
+
+        inline friend HeapNode<Node_t, Compare> * fetch_work(const CafeWindows<Node_t, Compare>& heap, WorkerMetadata& mdat){  // for worker
+            unsigned int i = 0;
+            const unsigned int top_size = heap.top_queue_size.load(std::memory_order_relaxed);
+            const unsigned int recent_size = heap.recent_queue_size.load(std::memory_order_relaxed);
+            while (i < top_size+recent_size){
+                unsigned int q_ind;
+                HeapNode<Node_t, Compare>* * both_q;
+                HeapNode<Node_t, Compare>* n;
+                if(i < top_size){
+                    both_q = heap._heap_top;
+                    q_ind = heap.rnv(i, top_size);
+                }
+                else{
+                    q_ind = heap.rnv(i, recent_size);
+                    both_q = heap._recent_push;
+                }
+                auto rpi = heap._recent_push_index;
+                n = both_q[q_ind];
+                // switch(heap.getWorkerState()){
+                //     case WorkerState::both:
+                //         n = both_q[q_ind];
+                //         break;
+                //     case WorkerState::heapTop:
+                //         n = heap._heap_top[q_ind];
+                //         break;
+                //     case WorkerState::recentPush:
+                //         n = heap._recent_push[q_ind];
+                //         break;
+                //     default:
+                //         n = nullptr;
+                // }
+                if(n != nullptr && n->reserve()){
+                    if(i < top_size){
+                        mdat.heap_top_fetch[q_ind]++;
+                        n->ee = ExpansionEntry(WorkerState::heapTop, q_ind);
+                    }
+                    else{
+                        std::size_t q_i = (recent_size + (q_ind - rpi % recent_size)) % recent_size;
+                        mdat.recent_push_fetch[q_i]++;
+                        n->ee = ExpansionEntry(WorkerState::recentPush, q_i);
+                    }
+                    return n;
+                }
+                ++i;
+            } 
+            return nullptr;
+        }
+
+        inline WorkerState getWorkerState() const{
+            return workerState.load(std::memory_order_acquire);
+        }
+};
+
+template <typename Node_t, typename Compare>
+class CafeMinBinaryHeap : public CafeWindows<Node_t, Compare>{
+    private:
+        using CafeWindows<Node_t, Compare>::_heap_top;
+        using CafeWindows<Node_t, Compare>::top_queue_size;
+
+        ReservedArray<HeapNode<Node_t, Compare>*> _storage;  // backs _data
+        std::size_t size;       // size of heap 
+        HeapNode<Node_t, Compare>* * _data; // of atomic pointers to nodes
+
         inline void swap_helper(handle_t i, handle_t j, HeapNode<Node_t, Compare> * xi, HeapNode<Node_t, Compare> * xj){
             // std::cerr << "swap_helper: " << i << " " << j << "\n";
             std::swap(xi->handle, xj->handle);                  // workers don't get to touch handles
@@ -292,27 +982,10 @@ class CafeMinBinaryHeap{
             }
         }
 
-        inline void setWorkerTop(){
-            workerState.store(WorkerState::heapTop, std::memory_order_release);
-        }
-
-        inline void setWorkerRecent(){
-            workerState.store(WorkerState::recentPush, std::memory_order_release);
-        }
-
-        inline void setWorkerBoth(){
-            workerState.store(WorkerState::both, std::memory_order_release);
-        }
-
-        inline void push_recent(HeapNode<Node_t, Compare> * n){
-            assert(workerState == WorkerState::heapTop || workerState == WorkerState::neither);
-            assert(n != nullptr);
-            _recent_push[recent_next_index()] = n;
-        }
-
         inline void copyTop(){
-            assert(workerState == WorkerState::recentPush || workerState == WorkerState::neither);
-            for(std::size_t i = 1; i <= top_queue_size; i++){
+            assert(this->workerState == WorkerState::recentPush || this->workerState == WorkerState::neither);
+            const unsigned int top_size = top_queue_size.load(std::memory_order_relaxed);
+            for(std::size_t i = 1; i <= top_size; i++){
                 if(i >= size){
                     // if(_heap_top[i] == nullptr){
                     //     return;
@@ -327,28 +1000,10 @@ class CafeMinBinaryHeap{
 
 
     public:  
-        std::atomic<WorkerState> workerState;     
-        inline CafeMinBinaryHeap(std::size_t capacity, std::size_t recent_queue_capacity, std::size_t top_queue_capacity):_capacity(capacity),recent_queue_size(recent_queue_capacity),top_queue_size(top_queue_capacity),_recent_push_index(0),workerState(WorkerState::neither){
+        inline CafeMinBinaryHeap(std::size_t capacity, std::size_t recent_queue_capacity, std::size_t top_queue_capacity):CafeWindows<Node_t, Compare>(recent_queue_capacity, top_queue_capacity),_storage(capacity){
             // setup heap before workers!
-            _data = reinterpret_cast<HeapNode<Node_t, Compare>* *>(std::malloc(capacity * sizeof(HeapNode<Node_t, Compare> *)));
-            if(_data == nullptr){
-                std::cerr << "Error bad malloc of heap\n";
-                exit(-1);
-            }
+            _data = _storage.data();
             size = 0;
-
-            _heap_top = new HeapNode<Node_t, Compare>*[top_queue_capacity];
-            _recent_push = new HeapNode<Node_t, Compare>*[recent_queue_capacity];
-            for(std::size_t i = 0; i < top_queue_capacity; i++){
-                _heap_top[i] = nullptr;
-            }
-            for(std::size_t i = 0; i < recent_queue_capacity; i++){
-                _recent_push[i] = nullptr;
-            }
-        }
-
-        inline ~CafeMinBinaryHeap(){
-            free(_data);
         }
 
         inline HeapNode<Node_t, Compare> * get(handle_t i) const{
@@ -363,26 +1018,23 @@ class CafeMinBinaryHeap{
        
 
         inline void pop(){
-            setWorkerRecent();
+            this->setWorkerRecent();
             copyTop();
-            setWorkerBoth();
+            this->setWorkerBoth();
             std::size_t s = size;
             swap(--s, 0);
             push_down(0, s);
             size = s; 
+            this->publish_work();
         }
 
-        inline void batch_recent_push(HeapNode<Node_t, Compare> * nodes, const unsigned int nodes_size){
-            setWorkerTop();
-            for(unsigned int i = 0; i < std::min(nodes_size, recent_queue_size); i++){
-                push_recent(&nodes[i]);
-                nodes[i].zero();
-            }
-            setWorkerBoth();
+        inline bool contains(const HeapNode<Node_t, Compare> * node) const{ // MAIN THREAD ONLY
+            return node->handle < size && _data[node->handle] == node;
         }
 
         inline void push(HeapNode<Node_t, Compare> * node){
             std::size_t s = size;
+            _storage.ensure(s + 1);
             node->handle = s;
             _data[s] = node;
             pull_up(s);
@@ -399,52 +1051,6 @@ class CafeMinBinaryHeap{
             return size == 0;
         }
 
-        inline friend HeapNode<Node_t, Compare> * fetch_work(const CafeMinBinaryHeap<Node_t, Compare>& heap, WorkerMetadata& mdat){  // for worker
-            unsigned int i = 0;
-            while (i < heap.top_queue_size+heap.recent_queue_size){
-                unsigned int q_ind;
-                HeapNode<Node_t, Compare>* * both_q;
-                HeapNode<Node_t, Compare>* n;
-                if(i < heap.top_queue_size){
-                    both_q = heap._heap_top;
-                    q_ind = heap.rnv(i, heap.top_queue_size);
-                }
-                else{
-                    q_ind = heap.rnv(i, heap.recent_queue_size);
-                    both_q = heap._recent_push;
-                }
-                auto rpi = heap._recent_push_index;
-                n = both_q[q_ind];
-                // switch(heap.getWorkerState()){
-                //     case WorkerState::both:
-                //         n = both_q[q_ind];
-                //         break;
-                //     case WorkerState::heapTop:
-                //         n = heap._heap_top[q_ind];
-                //         break;
-                //     case WorkerState::recentPush:
-                //         n = heap._recent_push[q_ind];
-                //         break;
-                //     default:
-                //         n = nullptr;
-                // }
-                if(n != nullptr && n->reserve()){
-                    if(i < heap.top_queue_size){
-                        mdat.heap_top_fetch[q_ind]++;
-                        n->ee = ExpansionEntry(WorkerState::heapTop, q_ind);
-                    }
-                    else{
-                        std::size_t q_i = (heap.recent_queue_size + (q_ind - rpi)) % heap.recent_queue_size;
-                        mdat.recent_push_fetch[q_i]++;
-                        n->ee = ExpansionEntry(WorkerState::recentPush, q_i);
-                    }
-                    return n;
-                }
-                ++i;
-            } 
-            return nullptr;
-        }
-
         inline bool heap_property_helper(handle_t i) const{
             if (i >= size){
                 return true;
@@ -478,10 +1084,6 @@ class CafeMinBinaryHeap{
             return true;
         }
 
-        inline WorkerState getWorkerState() const{
-            return workerState.load(std::memory_order_acquire);
-        }
-
         inline std::size_t get_size() const{
             return size;
         }
@@ -506,4 +1108,235 @@ class CafeMinBinaryHeap{
             // }
             return stream;
         }
-};
\ No newline at end of file
+};
+
+// CafeDaryHeap is a drop in replacement for CafeMinBinaryHeap with Arity
+// children per node.  Each entry keeps the node's f and g next to its
+// pointer, so sifting compares entries without touching the nodes, and the
+// sifts move a hole instead of swapping.  Entries are ordered like CAFE's
+// Node::pred: lowest f first, ties to the highest g.  The array is offset so
+// that every group of siblings starts on a 64 byte boundary.
+template <typename Node_t, typename Compare, unsigned int Arity = 4>
+class CafeDaryHeap : public CafeWindows<Node_t, Compare>{
+    static_assert(Arity >= 2, "a heap needs at least two children per node");
+
+    private:
+        using CafeWindows<Node_t, Compare>::_heap_top;
+        using CafeWindows<Node_t, Compare>::top_queue_size;
+
+        struct Entry{
+            decltype(Node_t::f) f;
+            decltype(Node_t::g) g;
+            HeapNode<Node_t, Compare> * node;
+        };
+
+        ReservedArray<Entry> _storage;  // backs _data
+        std::size_t size;
+        Entry * _data;
+
+        static inline bool before(const Entry& a, const Entry& b){
+            return a.f < b.f || (a.f == b.f && a.g > b.g);
+        }
+
+        static inline Entry entry(HeapNode<Node_t, Compare> * node){
+            return Entry{node->search_node.f, node->search_node.g, node};
+        }
+
+        inline void place(handle_t i, const Entry& e){
+            _data[i] = e;
+            e.node->handle = i;
+        }
+
+        inline void pull_up(handle_t i, const Entry& e){
+            while(i > 0){
+                handle_t p = (i - 1) / Arity;
+                if(!before(e, _data[p])){
+                    break;
+                }
+                place(i, _data[p]);
+                i = p;
+            }
+            place(i, e);
+        }
+
+        inline void push_down(handle_t i, const Entry& e, const std::size_t s){
+            for(;;){
+                handle_t first = Arity * i + 1;
+                if(first >= s){
+                    break;
+                }
+                handle_t last = std::min<handle_t>(first + Arity, s);
+                handle_t best = first;
+                for(handle_t c = first + 1; c < last; c++){
+                    if(before(_data[c], _data[best])){
+                        best = c;
+                    }
+                }
+                if(!before(_data[best], e)){
+                    break;
+                }
+                place(i, _data[best]);
+                i = best;
+            }
+            place(i, e);
+        }
+
+        inline void copyTop(){
+            assert(this->workerState == WorkerState::recentPush || this->workerState == WorkerState::neither);
+            const unsigned int top_size = top_queue_size.load(std::memory_order_relaxed);
+            for(std::size_t i = 1; i <= top_size; i++){
+                _heap_top[i-1] = i < size ? _data[i].node : nullptr;
+            }
+        }
+
+    public:
+        inline CafeDaryHeap(std::size_t capacity, std::size_t recent_queue_capacity, std::size_t top_queue_capacity):CafeWindows<Node_t, Compare>(recent_queue_capacity, top_queue_capacity),_storage(capacity + Arity - 1),size(0){
+            _data = _storage.data() + (Arity - 1);  // children of i start at Arity*(i+1) in storage
+        }
+
+        inline HeapNode<Node_t, Compare> * get(handle_t i) const{
+            assert(size > i);
+            return _data[0].node;
+        }
+
+        inline const HeapNode<Node_t, Compare>& top() const{
+            return *get(0);
+        }
+
+        inline void pop(){
+            this->setWorkerRecent();
+            copyTop();
+            this->setWorkerBoth();
+            std::size_t s = size - 1;
+            if(s > 0){
+                push_down(0, _data[s], s);
+            }
+            size = s;
+            this->publish_work();
+        }
+
+        inline bool contains(const HeapNode<Node_t, Compare> * node) const{ // MAIN THREAD ONLY
+            return node->handle < size && _data[node->handle].node == node;
+        }
+
+        inline void push(HeapNode<Node_t, Compare> * node){
+            std::size_t s = size;
+            _storage.ensure(s + Arity);
+            pull_up(s, entry(node));
+            ++size;
+        }
+
+        inline void decrease_key(handle_t i, HeapNode<Node_t, Compare> * node){
+            pull_up(i, entry(node));
+        }
+
+        inline bool empty() const{ // MAIN THREAD ONLY
+            return size == 0;
+        }
+
+        inline bool heap_property() const{
+            for(std::size_t i = 1; i < size; i++){
+                if(before(_data[i], _data[(i - 1) / Arity])){
+                    return false;
+                }
+                if(_data[i].f != _data[i].node->search_node.f || _data[i].g != _data[i].node->search_node.g){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline bool check_handles() const{
+            for(std::size_t i = 0; i < size; i++){
+                if(_data[i].node->handle != i){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline std::size_t get_size() const{
+            return size;
+        }
+
+        inline friend std::ostream& operator<<(std::ostream& stream, const CafeDaryHeap<Node_t, Compare, Arity>& heap){
+            for(std::size_t i = 0; i < heap.size; i++){
+                stream << heap._data[i].node->handle << ": " << heap._data[i].node->search_node << "\n";
+            }
+            return stream;
+        }
+};
+
+// WindowTuner resizes the speculation windows of a CAFE open list from
+// where the precomputed expansions the main thread actually used came from.
+// Every update looks at the hits since the previous one: a window whose
+// useful hits reach its far end is doubled, and a window whose hits stay in
+// its front half is halved when most speculation goes unused.
+class WindowTuner{
+    private:
+        std::vector<std::size_t> _top_seen, _recent_seen;
+        std::size_t _speculated_seen, _used_seen;
+        std::size_t _resizes;
+
+        // delta returns the hits since the last update and moves seen forward.
+        static std::vector<std::size_t> delta(const std::vector<std::size_t>& now, std::vector<std::size_t>& seen){
+            std::vector<std::size_t> d(now.size());
+            seen.resize(now.size(), 0);
+            for(std::size_t i = 0; i < now.size(); i++){
+                d[i] = now[i] - seen[i];
+                seen[i] = now[i];
+            }
+            return d;
+        }
+
+        static unsigned int tune(unsigned int size, const std::vector<std::size_t>& hits, bool wasteful){
+            std::size_t total = 0;
+            unsigned int last = 0;  // one past the deepest position with a hit
+            for(unsigned int i = 0; i < size && i < hits.size(); i++){
+                total += hits[i];
+                if(hits[i] > 0){
+                    last = i + 1;
+                }
+            }
+            if(total == 0){
+                return wasteful ? size / 2 : size;
+            }
+            if(4 * last > 3 * size){
+                return 2 * size;
+            }
+            if(wasteful && 2 * last <= size){
+                return size / 2;
+            }
+            return size;
+        }
+
+    public:
+        WindowTuner():_speculated_seen(0),_used_seen(0),_resizes(0){}
+
+        // update takes the main thread's record of used precomputed
+        // expansions and the running counts of speculated and used
+        // expansions.
+        template <typename Heap>
+        inline void update(Heap& heap, const WorkerMetadata& used_source, std::size_t speculated, std::size_t used){
+            std::size_t spec = speculated - _speculated_seen;
+            std::size_t hit = used - _used_seen;
+            _speculated_seen = speculated;
+            _used_seen = used;
+            auto top_hits = delta(used_source.heap_top_fetch, _top_seen);
+            auto recent_hits = delta(used_source.recent_push_fetch, _recent_seen);
+            if(spec == 0){
+                return;  // workers were idle, nothing to learn from
+            }
+            bool wasteful = 2 * hit < spec;
+            unsigned int top = tune(heap.top_window(), top_hits, wasteful);
+            unsigned int recent = tune(heap.recent_window(), recent_hits, wasteful);
+            if(top != heap.top_window() || recent != heap.recent_window()){
+                heap.resize_windows(top, recent);
+                _resizes++;
+            }
+        }
+
+        inline std::size_t resizes() const{
+            return _resizes;
+        }
+};
@@ -248,6 +248,37 @@ struct GridNav {
 		fprintf(out, "%u, %u\n", coord.first, coord.second);
 	}
 
+	// nstates bounds the number of states, which the closed lists
+	// use to size themselves.
+	unsigned long nstates() const {
+		return map->sz;
+	}
+
+	// The abstraction used by PBNF divides the map into about
+	// Ablocks by Ablocks rectangular blocks of cells.
+	enum { Ablocks = 32 };
+
+	unsigned int nblocks() const {
+		return ablocksx() * ablocksy();
+	}
+
+	unsigned int abstract(State &s) const {
+		auto c = map->coord(s.loc);
+		return (c.second / ablockh()) * ablocksx() + c.first / ablockw();
+	}
+
+	void abstractsuccs(unsigned int blk, std::vector<unsigned int> &succs) const {
+		int nx = ablocksx(), ny = ablocksy();
+		int x = blk % nx, y = blk / nx;
+		for (int dy = -1; dy <= 1; dy++) {
+		for (int dx = -1; dx <= 1; dx++) {
+			if ((dx == 0 && dy == 0) || x+dx < 0 || x+dx >= nx || y+dy < 0 || y+dy >= ny)
+				continue;
+			succs.push_back((y+dy) * nx + x+dx);
+		}
+		}
+	}
+
 	// pathcost returns the cost of the given path.
 	virtual Cost pathcost(const std::vector<State>&, const std::vector<Oper>&,
 						bool printpath=false) const;
@@ -260,6 +291,14 @@ struct GridNav {
 
 private:
 
+	unsigned int ablockw() const { return (map->w + Ablocks - 1) / Ablocks; }
+
+	unsigned int ablockh() const { return (map->h + Ablocks - 1) / Ablocks; }
+
+	unsigned int ablocksx() const { return (map->w + ablockw() - 1) / ablockw(); }
+
+	unsigned int ablocksy() const { return (map->h + ablockh() - 1) / ablockh(); }
+
 	// manhattan returns the Manhattan distance.
 	int manhattan(int l0, int l1) const {
 		auto c0 = map->coord(l0), c1 = map->coord(l1);
@@ -14,7 +14,7 @@ template <class D> struct AnytimeEES : public SearchAlgorithm<D> {
 
 	struct Node {
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 
 		// values for tracking location in focal, open, and f-ordered list
 		bool open;
@@ -153,6 +153,7 @@ template <class D> struct AnytimeEES : public SearchAlgorithm<D> {
 		if(!cand || n->g < cand->g) {
 			cand = n;
 			sol_count++;
+			this->report((double)cand->g);
 			if(cleanup.empty()) {
 				  wt = 1.0;
 			} else {
@@ -201,7 +202,7 @@ template <class D> struct AnytimeEES : public SearchAlgorithm<D> {
 		while (!open.empty() && !SearchAlgorithm<D>::limit()) {
 			Node *n = select_node();
 
-			if(cand && n->f >= cand->f) {
+			if((cand && n->f >= cand->f) || this->pruned(n->f)) {
 				continue;
 			}
 			
@@ -226,6 +227,10 @@ template <class D> struct AnytimeEES : public SearchAlgorithm<D> {
 		if(cand) {
 			solpath<D, Node>(d, cand, this->res);
 		}
+		// Every node that could beat the incumbent was expanded,
+		// unless cheaper duplicates were dropped.
+		if(open.empty() && !dropdups)
+			this->proved();
 		this->finish();
 	}
 
@@ -277,7 +282,7 @@ private:
 			kid->d = d.d(e.state);
 			d.pack(kid->state, e.state);
 
-			if(cand && kid->f >= cand->g) {
+			if((cand && kid->f >= cand->g) || this->pruned(kid->f)) {
 				nodes->destruct(kid);
 				continue;
 			}
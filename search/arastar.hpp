@@ -22,8 +22,8 @@ template <class D> struct Arastar : public SearchAlgorithm<D> {
 	typedef typename D::Oper Oper;
 
 	struct Node {
-		ClosedEntry<Node, D> closedent;
-		ClosedEntry<Node, D> inconsent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> inconsent;
 		int openind;
 		Node *parent;
 		PackedState state;
@@ -159,6 +159,8 @@ template <class D> struct Arastar : public SearchAlgorithm<D> {
 
 			if (wt <= 1.0) {
 				optimal = true;
+				if (!this->limit())
+					this->proved();
 				break;
 			}
 			nextwt();
@@ -243,6 +245,7 @@ protected:
 			if (d.isgoal(state)) {
 				cost = (double) n->g;
 				solpath<D, Node>(d, n, this->res);
+				this->report(cost);
 				goal = true;
 			}
 			
@@ -252,7 +255,10 @@ protected:
 	}
 
 	bool goodnodes() {
-		return !open.empty() && (cost == Cost(-1) || cost > (*open.front())->fprime);
+		if (open.empty())
+			return false;
+		double fprime = (*open.front())->fprime;
+		return (cost == Cost(-1) || cost > fprime) && !this->pruned(fprime);
 	}
 
 	// findbound finds and returns the tightest bound for
@@ -481,6 +487,7 @@ private:
 			if (d.isgoal(state)) {
 				this->cost = (double) n->g;
 				solpath<D, Node>(d, n, this->res);
+				this->report(this->cost);
 				goal = true;
 			}
 
@@ -599,6 +606,7 @@ protected:
 			if (d.isgoal(state)) {
 				this->cost = (double) n->g;
 				solpath<D, Node>(d, n, this->res);
+				this->report(this->cost);
 				goal = true;
 			}
 
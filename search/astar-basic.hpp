@@ -26,10 +26,13 @@ template <class D> struct AstarBasic : public SearchAlgorithm<D> {
 	};
 
 
+	// The closed list is a map, so a Node needs no ClosedEntry, and
+	// its parent is a 32-bit index into the node pool.  With an
+	// 8-byte packed state that takes the tiles nodes from 48 bytes
+	// to 32.
 	struct Node {
-		ClosedEntry<Node, D> closedent;
 		int openind;
-		Node *parent;
+		PoolIdx parent;
 		PackedState state;
 		Oper op, pop;
 		Cost f, g;
@@ -37,10 +40,6 @@ template <class D> struct AstarBasic : public SearchAlgorithm<D> {
 		Node() : openind(-1) {
 		}
 
-		static ClosedEntry<Node, D> &closedentry(Node *n) {
-			return n->closedent;
-		}
-
 		static PackedState &key(Node *n) {
 			return n->state;
 		}
@@ -83,7 +82,7 @@ template <class D> struct AstarBasic : public SearchAlgorithm<D> {
 
 	AstarBasic(int argc, const char *argv[]) :
 		SearchAlgorithm<D>(argc, argv) {
-		nodes = new Pool<Node>();
+		nodes = new IdxPool<Node>();
 		for (int i = 0; i < argc; i++) {
 			if (strcmp(argv[i], "-exp") == 0){
 				extra_calcs = strtod(argv[++i], NULL);
@@ -114,7 +113,7 @@ template <class D> struct AstarBasic : public SearchAlgorithm<D> {
 			// std::cout << "Popped Node: " << *n << std::endl;
 
 			if (d.isgoal(state)) {
-				solpath<D, Node>(d, n, this->res);
+				solpath(d, n);
 				break;
 			}
 
@@ -128,7 +127,7 @@ template <class D> struct AstarBasic : public SearchAlgorithm<D> {
 		open.clear();
 		closed.clear();
 		delete nodes;
-		nodes = new Pool<Node>();
+		nodes = new IdxPool<Node>();
 	}
 
 	virtual void output(FILE *out) {
@@ -142,6 +141,7 @@ private:
 
 	void expand(D &d, Node *n, State &state) {
 		SearchAlgorithm<D>::res.expd++;
+		PoolIdx nind = nodes->index(n);
 
 		typename D::Operators ops(d, state);
 		for (unsigned int i = 0; i < ops.size(); i++) {
@@ -156,9 +156,7 @@ private:
 			typename D::Edge e(d, state, op);
 			kid->g = n->g + e.cost;
 			d.pack(kid->state, e.state);
-			// comment out below along with debug
-			kid->f = kid->g + d.h(e.state);
-			kid->parent = n;
+			kid->parent = nind;
 			kid->op = op;
 			kid->pop = e.revop;
 			// unsigned long hash = kid->state.hash(&d);
@@ -170,13 +168,21 @@ private:
 					nodes->destruct(kid);
 					continue;
 				}
+				if (hbatch.pending(dup)) { // flush sets f and pushes it
+					dup->g = kid->g;
+					dup->parent = nind;
+					dup->op = op;
+					dup->pop = e.revop;
+					nodes->destruct(kid);
+					continue;
+				}
 				// std::cerr << "duplicate:" << *kid << " " << *dup << " same state? "<< StateEq()(kid->state, dup->state) << "\n";
 				bool isopen = open.mem(dup);
 				if (isopen)
 					open.pre_update(dup);
 				dup->f = dup->f - dup->g + kid->g;
 				dup->g = kid->g;
-				dup->parent = n;
+				dup->parent = nind;
 				dup->op = op;
 				dup->pop = e.revop;
 				if (isopen) {
@@ -190,16 +196,14 @@ private:
 				continue;
 			}
 
-			kid->f = kid->g + d.h(e.state);
-			kid->parent = n;
-			kid->op = op;
-			kid->pop = e.revop;
 			// std::cout << "Adding successor " << std::endl;// *kid << std::endl;
 			closed[kid->state]  = kid;
-			open.push(kid);
+			hbatch.add(d, e.state, kid, [this](Node *k, Cost) { open.push(k); });
 			// std::cerr << "push:" << *kid << "\n";
 			// std::cerr << open << "\n";
 		}
+		// new kids wait for a batched heuristic before going on open
+		hbatch.flush(d, [this](Node *k, Cost) { open.push(k); });
 		long double sum = 0;
 		for(size_t i = 0; i < extra_calcs; i++){
 			sum = sin(sum + rand());
@@ -213,14 +217,32 @@ private:
 		n0->g = Cost(0);
 		n0->f = d.h(s0);
 		n0->pop = n0->op = D::Nop;
-		n0->parent = NULL;
+		n0->parent = 0;
 		return n0;
 	}
 
+	// solpath is the solpath of search.hpp for parents that are
+	// pool indices.
+	void solpath(D &d, Node *goal) {
+		this->res.ops.clear();
+		this->res.path.clear();
+		for (Node *n = goal; n; n = (*nodes)[n->parent]) {
+			State buf, &state = d.unpack(buf, n->state);
+			this->res.path.push_back(state);
+			if (n->parent)
+				this->res.ops.push_back(n->op);
+		}
+	}
+
 	size_t extra_calcs = 0;
 	double total_sum;
-	OpenList<Node, Node, Cost> open;
+	// integer costs keep the 2d bucketed list, the others fall back
+	// to a radix heap instead of a binary heap
+	std::conditional_t<std::is_same_v<Cost, IntOpenCost>,
+		OpenList<Node, Node, Cost>,
+		RadixOpenList<Node, Node, Cost>> open;
  	// ClosedList<Node, Node, D> closed;
 	boost::unordered_flat_map<PackedState, Node *, StateHasher, StateEq> closed;
-	Pool<Node> *nodes;
+	IdxPool<Node> *nodes;
+	HeuristicBatch<D, Node> hbatch;
 };
@@ -13,7 +13,7 @@ template <class D> struct Astar_dump : public SearchAlgorithm<D> {
 	typedef typename D::Oper Oper;
 	
 	struct Node {
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 		int openind;
 		PackedState state;
 		Oper op, pop;
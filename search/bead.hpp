@@ -57,7 +57,7 @@ template <class D> struct BeadSearch : public SearchAlgorithm<D> {
 		}
 
     private:
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
     
 	};
 
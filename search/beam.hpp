@@ -2,6 +2,15 @@
 #pragma once                                                                    
 #include "../search/search.hpp"                                                 
 #include "../utils/pool.hpp"
+
+#include <algorithm>
+#include <barrier>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define BEAM_PART_CLOSED_SIZE 1000003 // initial closed list size of each partition with -threads
                                                                                 
 template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 
@@ -16,6 +25,7 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 		PackedState state;
 		Oper op, pop;
 		Cost f, g;
+		unsigned long hash;	// of state, breaks ties in pred
 
 		Node() : openind(-1) {
 		}
@@ -38,10 +48,15 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 			return n->openind;
 		}
 
-		/* Indicates whether Node a has better value than Node b. */
+		/* Indicates whether Node a has better value than Node b.
+		 * The hash makes the order total, so that the serial
+		 * search and the merge of -threads keep the same nodes. */
 		static bool pred(Node *a, Node *b) {
-			if (a->f == b->f)
+			if (a->f == b->f) {
+				if (a->g == b->g)
+					return a->hash < b->hash;
 				return a->g > b->g;
+			}
 			return a->f < b->f;
 		}
 
@@ -56,7 +71,7 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 		}
 
     private:
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
     
 	};
 
@@ -68,10 +83,14 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 				width = atoi(argv[++i]);
 			if (strcmp(argv[i], "-dropdups") == 0)
 				dropdups = true;
+			if (i < argc - 1 && strcmp(argv[i], "-threads") == 0)
+				nthreads = strtoul(argv[++i], NULL, 10);
 		}
 
 		if (width < 1)
 			fatal("Must specify a >0 beam width using -width");
+		if (nthreads == 0)
+			nthreads = 1;
     
 		nodes = new Pool<Node>();
 	}
@@ -81,6 +100,10 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 	}
 
 	void search(D &d, typename D::State &s0) {
+		if (nthreads > 1) {
+			parsearch(d, s0);
+			return;
+		}
 		this->start();
 		closed.init(d);
 
@@ -101,7 +124,7 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 			while(c < width && !open.empty()) {
 				Node *n = open.pop();
 
-				unsigned long hash = n->state.hash(&d);
+				unsigned long hash = n->hash;
 				Node *dup = closed.find(n->state, hash);
 				if(!dup) {
 				  closed.add(n, hash);
@@ -155,18 +178,292 @@ template <class D> struct BeamSearch : public SearchAlgorithm<D> {
 		closed.clear();
 		delete nodes;
 		nodes = new Pool<Node>();
+		workers.clear();
 	}
 
 	virtual void output(FILE *out) {
 		SearchAlgorithm<D>::output(out);
-		closed.prstats(stdout, "closed ");
+		if (nthreads > 1) {
+			std::vector<ClosedList<Node, Node, D>*> parts;
+			for (auto &w : workers)
+				parts.push_back(&w->closed);
+			ClosedList<Node, Node, D>::prstats(stdout, "closed ", parts);
+		} else
+			closed.prstats(stdout, "closed ");
 		dfpair(stdout, "open list type", "%s", open.kind());
 		dfpair(stdout, "node size", "%u", sizeof(Node));
+		dfpair(stdout, "threads", "%lu", nthreads);
 	}
 
 
 private:
 
+	// A Kid is a successor on its way through a parallel layer.
+	struct Kid {
+		Node *n;
+		unsigned long hash;
+		Node *dup;	// the closed node that n improves on, if any
+	};
+
+	// A Worker holds one thread's part of a parallel layer.  It
+	// expands a share of the beam, sending each kid to the partition
+	// that its hash maps to, and it owns one partition: the closed
+	// list of its states and the kids that survive duplicate
+	// elimination, best first.
+	struct alignas(64) Worker {
+		Worker(size_t nparts) : out(nparts), closed(BEAM_PART_CLOSED_SIZE) {
+		}
+
+		Pool<Node> nodes;
+		std::vector<std::vector<Kid>> out;
+		std::vector<Kid> kept;
+		ClosedList<Node, Node, D> closed;
+		Node *cand = NULL;
+		unsigned long expd = 0, gend = 0, dups = 0, reopnd = 0;
+	};
+
+	// parsearch is the search with -threads.  Each layer is expanded
+	// in parallel, the kids are partitioned by hash and each
+	// partition drops its duplicates and sorts its survivors in
+	// parallel.  The next beam is the best width survivors, which is
+	// a prefix of each partition's, and the threads add them to the
+	// closed lists of their partitions.  As pred is a total order,
+	// up to distinct states with equal hashes, f and g, the beam
+	// keeps the same nodes as the serial search.
+	void parsearch(D &d, typename D::State &s0) {
+		this->start();
+
+		workers.clear();
+		for (size_t i = 0; i < nthreads; i++) {
+			workers.emplace_back(new Worker(nthreads));
+			workers.back()->closed.init(d);
+		}
+
+		// the helper threads live for the whole search, see parallel
+		std::barrier<> sync(nthreads);
+		this->sync = &sync;
+		std::vector<std::jthread> threads;
+		for (size_t t = 1; t < nthreads; t++)
+			threads.emplace_back(&BeamSearch::helper, this, t);
+
+		cand = NULL;
+		Node *n0 = init(d, s0);
+		std::vector<Node*> beam(1, n0);
+		std::vector<size_t> take(nthreads);
+
+		while (!beam.empty() && !SearchAlgorithm<D>::limit()) {
+			parallel([&](size_t t) { parexpand(d, t, beam); });
+
+			for (auto &w : workers) {
+				if (w->cand && (!cand || w->cand->g < cand->g))
+					cand = w->cand;
+				w->cand = NULL;
+			}
+			if (cand || this->lim.timeup) {
+				// the rest of the layer is abandoned
+				for (auto &w : workers) {
+					for (auto &o : w->out) {
+						for (Kid &k : o) {
+							if (k.n != cand)
+								w->nodes.destruct(k.n);
+						}
+						o.clear();
+					}
+				}
+				break;
+			}
+
+			parallel([&](size_t p) { dedup(d, p); });
+
+			// The best width survivors, as counts of each
+			// partition's best first survivors.
+			std::fill(take.begin(), take.end(), 0);
+			for (int c = 0; c < width; c++) {
+				Node *best = NULL;
+				size_t bestp = 0;
+				for (size_t p = 0; p < nthreads; p++) {
+					std::vector<Kid> &kept = workers[p]->kept;
+					if (take[p] < kept.size() && (!best || Node::pred(kept[take[p]].n, best))) {
+						best = kept[take[p]].n;
+						bestp = p;
+					}
+				}
+				if (!best)
+					break;
+				take[bestp]++;
+			}
+
+			parallel([&](size_t p) { select(p, take[p]); });
+
+			beam.clear();
+			for (size_t p = 0; p < nthreads; p++) {
+				Worker &w = *workers[p];
+				for (size_t i = 0; i < take[p]; i++)
+					beam.push_back(w.kept[i].n);
+				w.kept.clear();
+			}
+
+			tally();
+		}
+		tally();
+
+		job = nullptr; // let the helpers go
+		sync.arrive_and_wait();
+		threads.clear();
+		this->sync = NULL;
+
+		if (cand)
+			solpath<D, Node>(d, cand, this->res);
+		this->finish();
+	}
+
+	// tally moves the workers' counts to the search result.
+	void tally() {
+		for (auto &w : workers) {
+			this->res.expd += w->expd;
+			this->res.gend += w->gend;
+			this->res.dups += w->dups;
+			this->res.reopnd += w->reopnd;
+			w->expd = w->gend = w->dups = w->reopnd = 0;
+		}
+	}
+
+	// parallel runs f(t) for each thread number t, the calling
+	// thread being number 0 and the others parsearch's helpers.
+	// The barrier starts them on f and waits for them to finish.
+	void parallel(std::function<void(size_t)> f) {
+		job = f;
+		sync->arrive_and_wait();
+		job(0);
+		sync->arrive_and_wait();
+	}
+
+	// helper is the loop of helper thread t, it runs each job that
+	// parallel hands out until the job is empty.
+	void helper(size_t t) {
+		for ( ; ; ) {
+			sync->arrive_and_wait();
+			if (!job)
+				return;
+			job(t);
+			sync->arrive_and_wait();
+		}
+	}
+
+	// parexpand expands thread t's share of the beam.
+	void parexpand(D &d, size_t t, std::vector<Node*> &beam) {
+		Worker &w = *workers[t];
+		for (size_t i = t; i < beam.size() && !this->lim.timeup; i += nthreads) {
+			Node *n = beam[i];
+			State buf, &state = d.unpack(buf, n->state);
+			w.expd++;
+
+			typename D::Operators ops(d, state);
+			for (unsigned int j = 0; j < ops.size(); j++) {
+				if (ops[j] == n->pop)
+					continue;
+				w.gend++;
+
+				Node *kid = w.nodes.construct();
+				assert (kid);
+				typename D::Edge e(d, state, ops[j]);
+				kid->g = n->g + e.cost;
+				d.pack(kid->state, e.state);
+				kid->f = kid->g + d.h(e.state);
+				kid->parent = n;
+				kid->op = ops[j];
+				kid->pop = e.revop;
+
+				if (d.isgoal(e.state) && (!w.cand || kid->g < w.cand->g))
+					w.cand = kid;
+
+				unsigned long hash = kid->state.hash(&d);
+				kid->hash = hash;
+				w.out[part(hash)].push_back(Kid{kid, hash, NULL});
+			}
+		}
+	}
+
+	// dedup gathers the kids of partition p, keeps the best of each
+	// state if it improves on the closed list, and sorts them best
+	// first.
+	void dedup(D &d, size_t p) {
+		Worker &w = *workers[p];
+		std::vector<Kid> &kids = w.kept;
+		kids.clear();
+		for (auto &v : workers) {
+			kids.insert(kids.end(), v->out[p].begin(), v->out[p].end());
+			v->out[p].clear();
+		}
+
+		// Equal states have equal hashes, so after this sort the
+		// first of each state in a run of equal hashes is the best.
+		std::sort(kids.begin(), kids.end(), [](const Kid &a, const Kid &b) {
+			if (a.hash != b.hash)
+				return a.hash < b.hash;
+			return Node::pred(a.n, b.n);
+		});
+
+		size_t nkept = 0;
+		for (size_t i = 0; i < kids.size(); i++) {
+			Kid k = kids[i];
+			bool layerdup = false;
+			for (size_t j = nkept; j > 0 && kids[j-1].hash == k.hash; j--) {
+				if (kids[j-1].n->state.eq(&d, k.n->state)) {
+					layerdup = true;
+					break;
+				}
+			}
+			if (!layerdup) {
+				k.dup = w.closed.find(k.n->state, k.hash);
+				if (k.dup && (dropdups || k.n->g >= k.dup->g))
+					layerdup = true;
+			}
+			if (layerdup || k.dup)
+				w.dups++;
+			if (layerdup) {
+				w.nodes.destruct(k.n);
+				continue;
+			}
+			kids[nkept++] = k;
+		}
+		kids.resize(nkept);
+
+		std::sort(kids.begin(), kids.end(), [](const Kid &a, const Kid &b) {
+			return Node::pred(a.n, b.n);
+		});
+	}
+
+	// select adds the first n survivors of partition p to its closed
+	// list, or updates the closed node they improve on, and frees the
+	// rest.
+	void select(size_t p, size_t n) {
+		Worker &w = *workers[p];
+		for (size_t i = 0; i < w.kept.size(); i++) {
+			Kid &k = w.kept[i];
+			if (i >= n) {
+				w.nodes.destruct(k.n);
+				continue;
+			}
+			if (!k.dup) {
+				w.closed.add(k.n, k.hash);
+				continue;
+			}
+			w.reopnd++;
+			k.dup->f = k.dup->f - k.dup->g + k.n->g;
+			k.dup->g = k.n->g;
+			k.dup->parent = k.n->parent;
+			k.dup->op = k.n->op;
+			k.dup->pop = k.n->pop;
+		}
+	}
+
+	// part maps a hash to a partition.  The hash is mixed first so
+	// the partition does not correlate with the closed list bin.
+	size_t part(unsigned long h) {
+		return ((h * 0x9E3779B97F4A7C15ul) >> 32) % nthreads;
+	}
+
 	void expand(D &d, Node *n, State &state) {
 		SearchAlgorithm<D>::res.expd++;
 
@@ -187,6 +484,7 @@ private:
 		d.pack(kid->state, e.state);
 
 		kid->f = kid->g + d.h(e.state);
+		kid->hash = kid->state.hash(&d);
 		kid->parent = parent;
 		kid->op = op;
 		kid->pop = e.revop;
@@ -202,6 +500,7 @@ private:
 	Node *init(D &d, State &s0) {
 		Node *n0 = nodes->construct();
 		d.pack(n0->state, s0);
+		n0->hash = n0->state.hash(&d);
 		n0->g = Cost(0);
 		n0->f = d.h(s0);
 		n0->pop = n0->op = D::Nop;
@@ -212,7 +511,13 @@ private:
 
     int width;
     bool dropdups;
-	OpenList<Node, Node, Cost> open;
+	size_t nthreads = 1;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::barrier<> *sync = NULL;
+	std::function<void(size_t)> job;	// set by parallel
+	// a binary heap for every cost type, the bucketed list for
+	// integers would not follow pred's tie breaking
+	OpenList<Node, Node, double> open;
  	ClosedList<Node, Node, D> closed;
 	Pool<Node> *nodes;
 	Node *cand;
@@ -14,7 +14,7 @@ template <class D> struct Bugsy_slim : public SearchAlgorithm<D> {
 
 	struct Node {
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 		int openind;
 		Node *parent;
 		PackedState state;
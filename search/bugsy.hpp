@@ -16,7 +16,7 @@ template <class D> struct Bugsy : public SearchAlgorithm<D> {
 	typedef typename D::Oper Oper;
 
 	struct Node {
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 		int openind;
 		Node *parent;
 		PackedState state;
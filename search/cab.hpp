@@ -56,7 +56,7 @@ template <class D> struct CABSearch : public SearchAlgorithm<D> {
 		}
 
     private:
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
     
 	};
 
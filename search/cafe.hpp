@@ -2,7 +2,6 @@
 #pragma once
 #include "../search/search.hpp"
 #include "../Cafe_Heap/cafe_heap2.hpp"
-#include <boost/unordered/unordered_flat_map.hpp>
 #include <boost/circular_buffer.hpp>
 #include <unistd.h>
 
@@ -14,10 +13,21 @@
 #include <stop_token>
 
 #include <atomic>
+#include <type_traits>
 
-#define OPEN_LIST_SIZE 100000000
-#define TOP_QUEUE_SIZE 8
+#define OPEN_LIST_SIZE 100000000 // default -capacity, address space is reserved but only committed as used
+#define TOP_QUEUE_SIZE 8 // initial window sizes
 #define RECENT_QUEUE_SIZE 16
+#define TOP_QUEUE_MAX 64 // largest the windows may grow
+#define RECENT_QUEUE_MAX 64
+#define WINDOW_TUNE_INTERVAL 1024 // expansions between window resizes
+#define SPIN_ROUNDS 16 // failed fetches, with exponential backoff, before an idle worker parks
+#define RECLAIM_INTERVAL 64 // expansions between epoch advances
+#define PREFAULT_NODES 65536 // pool nodes each thread touches before it starts
+#define DEPTH2_MAX 8 // most children -depth2 may expand with their parent
+#ifndef CAFE_HEAP_ARITY
+#define CAFE_HEAP_ARITY 4 // children per open list node, 2 for CafeMinBinaryHeap
+#endif
 #define DEBUG true
 
 template <class D> struct CAFE : public SearchAlgorithm<D> {
@@ -34,6 +44,8 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 		}
 	};
 
+	struct NodeStateEq;
+
 	struct StateHasher{
 		inline unsigned long operator()(const PackedState& s) const{
 			return const_cast<PackedState&>(s).hash(nullptr);
@@ -48,7 +60,6 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 		PackedState state;
 		Oper op, pop;
 		Cost f, g;
-		// size_t nodes_expanded_at_time_of_expansion;
 
 		Node(){}
 
@@ -82,13 +93,17 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 		}
 	};
 
-	static inline void dump_closed(std::ostream& stream, const boost::unordered_flat_map<PackedState, HeapNode<Node, NodeComp> *, StateHasher, StateEq>& c){
-		stream << "Closed:\n";
-		for (const auto & elem: c){
-			stream << *((std::size_t *)(&elem.first)) << ": " << elem.second->search_node << "\n";
+	struct NodeStateEq{
+		bool operator()(const Node& lhs, const Node& rhs) const{
+			return StateEq()(lhs.state, rhs.state);
 		}
-		stream << "\n";
-	}
+	};
+
+	using Closed = SharedClosedList<Node, NodeComp, NodeStateEq>;
+
+	using OpenList = std::conditional_t<CAFE_HEAP_ARITY == 2,
+		CafeMinBinaryHeap<Node, NodeComp>,
+		CafeDaryHeap<Node, NodeComp, CAFE_HEAP_ARITY>>;
 
 	static inline std::size_t get_num_threads(int argc, const char *argv[]){
 		std::size_t num_threads = 1;
@@ -103,8 +118,23 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 		return num_threads;
 	}
 
+	// get_capacity returns the maximum number of nodes in each thread's
+	// pool and in the open list.
+	static inline std::size_t get_capacity(int argc, const char *argv[]){
+		std::size_t capacity = OPEN_LIST_SIZE;
+		for (int i = 0; i < argc; i++) {
+			if (strcmp(argv[i], "-capacity") == 0){
+				capacity = strtoull(argv[++i], NULL, 10);
+				if(capacity == 0) {
+					exit(1);
+				}
+			}
+		}
+		return capacity;
+	}
+
 	CAFE(int argc, const char *argv[]):
-	 SearchAlgorithm<D>(argc, argv),open(OPEN_LIST_SIZE, RECENT_QUEUE_SIZE, TOP_QUEUE_SIZE){
+	 SearchAlgorithm<D>(argc, argv),capacity(get_capacity(argc, argv)),reclaimer(get_num_threads(argc, argv)-1),open(capacity, RECENT_QUEUE_MAX, TOP_QUEUE_MAX),closed(reclaimer){
 		num_threads = 1;
 		for (int i = 0; i < argc; i++) {
 			if (strcmp(argv[i], "-threads") == 0){
@@ -116,15 +146,34 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 			if (strcmp(argv[i], "-exp") == 0){
 				extra_calcs = strtod(argv[++i], NULL);
 			}
+			if (strcmp(argv[i], "-hist") == 0){
+				record_delays = true;
+			}
+			if (strcmp(argv[i], "-fixedwin") == 0){
+				tune_windows = false;
+			}
+			if (strcmp(argv[i], "-spin") == 0){
+				park_idle = false;
+			}
+			if (strcmp(argv[i], "-nospecdd") == 0){
+				speculate_dups = false;
+			}
+			if (strcmp(argv[i], "-pin") == 0){
+				cpus = parsecpus(argv[++i]);
+			}
+			if (strcmp(argv[i], "-depth2") == 0){
+				depth2 = std::min<std::size_t>(strtoul(argv[++i], NULL, 10), DEPTH2_MAX);
+			}
 		}
+		open.resize_windows(TOP_QUEUE_SIZE, RECENT_QUEUE_SIZE);
 	    wmdat.resize(num_threads-1);
 		for(std::size_t i = 1; i < num_threads; i++){
-			wmdat[i-1].heap_top_fetch.resize(TOP_QUEUE_SIZE);
-        	wmdat[i-1].recent_push_fetch.resize(RECENT_QUEUE_SIZE);
+			wmdat[i-1].heap_top_fetch.resize(TOP_QUEUE_MAX);
+        	wmdat[i-1].recent_push_fetch.resize(RECENT_QUEUE_MAX);
 		}
 		node_pools.reserve(num_threads);
 		for (size_t i = 0; i < num_threads; i++){
-			node_pools.emplace_back(OPEN_LIST_SIZE);
+			node_pools.emplace_back(capacity, i);
 		}
 	}
 
@@ -134,6 +183,8 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 
 	void thread_speculate(D &d, size_t id, std::stop_token token, NodePool<Node, NodeComp>& nodes, WorkerMetadata& wm){
 		// NodePool<Node, NodeComp> nodes(OPEN_LIST_SIZE);
+		place_thread(id+1, nodes);
+		unsigned int misses = 0;
 		while(!token.stop_requested()){
 			// long double sum = 0;
 			// for(size_t i = 0; i < 10; i++){
@@ -168,19 +219,57 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 			// if (!found){
 			// 	thread_misses++;
 			// 	continue; // skip trying to search the open list
+				std::uint32_t seen = open.work_seq();
+				reclaimer.pin(id);
 				hn = fetch_work(open, wm);
 				if(hn == nullptr){
+					reclaimer.unpin(id);
 					thread_misses++;
+					// a stop requested since the loop test must not
+					// be slept through
+					if(token.stop_requested())
+						break;
+					if(park_idle && ++misses >= SPIN_ROUNDS){
+						auto park_start = std::chrono::steady_clock::now();
+						open.park(seen);
+						std::chrono::duration<double> parked = std::chrono::steady_clock::now() - park_start;
+						wm.parks++;
+						wm.parked_seconds += parked.count();
+						misses = 0;
+					}else{
+						for(unsigned int k = 0; k < (1u << std::min(misses, 10u)); k++)
+							cpu_relax();
+					}
 					continue;
 				}
+				misses = 0;
 			// }
 
+			if (record_delays){
+				wm.delays.add(expansion_clock.load(std::memory_order_relaxed) - hn->born);
+			}
+
 			Node* n = &(hn->search_node);
 			State buf, &state = d.unpack(buf, n->state);
 
-			auto successor_ret = expand(d, hn, nodes, state);
-			waste_time(extra_calcs);
-			hn->set_completed(successor_ret.first, successor_ret.second);
+			std::pair<HeapNode<Node, NodeComp> *, std::size_t> successor_ret(nullptr, 0);
+			try {
+				successor_ret = expand(d, hn, nodes, state, speculate_dups);
+				waste_time(extra_calcs);
+				if (depth2 > 0)
+					expand_best(d, successor_ret.first, successor_ret.second, nodes, wm);
+			} catch (std::bad_alloc&) { // pool is full, leave the rest to the main thread
+				if (successor_ret.second > 0)
+					drop_unpublished(nodes, successor_ret.first, successor_ret.second);
+				wm.pool_full = true;
+				reclaimer.unpin(id);
+				return;
+			}
+			if(!hn->set_completed(successor_ret.first, successor_ret.second) && successor_ret.second > 0){
+				// main thread got there first, never published
+				drop_unpublished(nodes, successor_ret.first, successor_ret.second);
+			}
+			reclaimer.unpin(id);
 			total_nodes_speculated++;
 		}
 	}
@@ -193,19 +282,21 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
         // volatile std::size_t * sum_i = &s_i;
 
 		size_t speculated_nodes_expanded = 0;
-		size_t manual_expansions = 0;
 		WorkerMetadata prec_expanded_source;
-		prec_expanded_source.heap_top_fetch.resize(TOP_QUEUE_SIZE);
-		prec_expanded_source.recent_push_fetch.resize(RECENT_QUEUE_SIZE);
+		prec_expanded_source.heap_top_fetch.resize(TOP_QUEUE_MAX);
+		prec_expanded_source.recent_push_fetch.resize(RECENT_QUEUE_MAX);
 
 		std::vector<std::jthread> threads;
 		std::stop_source stop_source;
+		StopOnExit stop_workers{stop_source, open};
+		open.unstop();
 		//std::latch start_latch(num_threads + 1);
 		
 		auto& nodes = node_pools[0];
+		place_thread(0, nodes);
 
 		HeapNode<Node, NodeComp> * hn0 = init(d, nodes, s0);
-		closed.emplace(hn0->search_node.state, hn0);
+		closed.insert(hn0);
 		open.push(hn0);
 
 		// Create threads after initial node is pushed
@@ -234,8 +325,8 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 				// 	std::cerr << "joined!";
 				// }
 				WorkerMetadata total_mdat;
-				total_mdat.heap_top_fetch.resize(TOP_QUEUE_SIZE);
-				total_mdat.recent_push_fetch.resize(RECENT_QUEUE_SIZE);
+				total_mdat.heap_top_fetch.resize(TOP_QUEUE_MAX);
+				total_mdat.recent_push_fetch.resize(RECENT_QUEUE_MAX);
 				for (std::size_t i = 1; i < num_threads; i++){
 					std::cerr << "Worker " << i << ": ";
 					std::cerr << wmdat[i-1].total() << "\n";
@@ -265,42 +356,12 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 					std::cerr << "Speculations Collided: " << speculations_collided << std::endl;
 					std::cerr << "Failed Reserves: " << failed_reserves << std::endl;
 					std::cerr << std::endl;
+					std::cerr << "Reclaimed Blocks: " << reclaimer.reclaimed() << std::endl;
+					std::cerr << "Blocks Awaiting Reclaim: " << reclaimer.pending() << std::endl;
+					std::cerr << std::endl;
 					// std::cerr << "Expansion Rate: " << SearchAlgorithm<D>::res.expd / elapsed_seconds_algo.count() << "/sec" << std::endl;
 					// std::cerr << "Observe Rate: " << total_nodes_observed / elapsed_seconds_algo.count() << "/sec" << std::endl;
 					std::cerr << std::endl;
-
-					// print histogram of node delays
-					// std::cerr << "Node Delays: " << std::endl;
-					// // bucket the delays in groups of 1000 (doesn't mean there are only 1000 buckets)
-					// // get size and divide by 1000 to get count of buckets
-					// size_t bucket_size = 1;
-					// size_t num_buckets = (OPEN_LIST_SIZE / bucket_size) + 1;
-					// std::vector<size_t> buckets = std::vector<size_t>(num_buckets, 0);
-					// for(size_t i = 0; i < OPEN_LIST_SIZE; i++){
-					// 	if (node_delays[i] == 0)
-					// 		continue;
-					// 	buckets[node_delays[i] / bucket_size]++;
-					// }
-					// for(size_t i = 0; i < num_buckets; i++){
-					// 	if (buckets[i] != 0)
-					// 		std::cerr << i * bucket_size << " - " << (i+1) * bucket_size << ": " << buckets[i] << std::endl;
-					// }
-
-					// std::cerr << "Speculated Node Delays: " << std::endl;
-					// // bucket the delays in groups of 1000 (doesn't mean there are only 1000 buckets)
-					// // get size and divide by 1000 to get count of buckets
-					// bucket_size = 1;
-					// num_buckets = (OPEN_LIST_SIZE / bucket_size) + 1;
-					// buckets = std::vector<size_t>(num_buckets, 0);
-					// for(size_t i = 0; i < OPEN_LIST_SIZE; i++){
-					// 	if (speculated_node_delays[i] == 0)
-					// 		continue;
-					// 	buckets[speculated_node_delays[i] / bucket_size]++;
-					// }
-					// for(size_t i = 0; i < num_buckets; i++){
-					// 	if (buckets[i] != 0)
-					// 		std::cerr << i * bucket_size << " - " << (i+1) * bucket_size << ": " << buckets[i] << std::endl;
-					// }
 				}
 				break;
 			}
@@ -309,16 +370,20 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 
 			//bool wasSpec;
 
-			if(hn->is_completed()){
+			successor_ret = hn->claim();
+			if(successor_ret.first != nullptr){
 				// std::cerr << "Speculated Node Expanded" << std::endl;
 				prec_expanded_source.add(hn->ee);
 				speculated_nodes_expanded++;
-				successor_ret = hn->get_successors();
+				if (hn->ee.state == WorkerState::nested)
+					nested_used++;
 				//wasSpec = true;
 			}else{
 				// std::cerr << "Manual Expansion" << std::endl;
 				manual_expansions++;
-				successor_ret = expand(d, hn, nodes, state);
+				if (record_delays)
+					manual_delays.add(std::uint32_t(SearchAlgorithm<D>::res.expd) - hn->born);
+				successor_ret = expand(d, hn, nodes, state, false);
 				waste_time(extra_calcs);
 			}
 
@@ -336,6 +401,12 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 
 			HeapNode<Node, NodeComp>* successors = successor_ret.first;
 			size_t n_precomputed_successors = successor_ret.second;
+			if (record_delays){
+				std::uint32_t now = SearchAlgorithm<D>::res.expd;
+				expansion_clock.store(now, std::memory_order_relaxed);
+				for (size_t i = 0; i < n_precomputed_successors; i++)
+					successors[i].born = now;
+			}
 			open.batch_recent_push(successors, n_precomputed_successors);
 
 			for (unsigned int i = 0; i < n_precomputed_successors; i++) {
@@ -344,42 +415,55 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 				Node *kid = &(successor->search_node);
 				assert(kid);
 
-				auto dup_it = closed.find(kid->state);
-				if (dup_it != closed.end()) { // if its in closed, check if dup is better
-					HeapNode<Node, NodeComp> * dup_hn = dup_it->second;
+				if (successor->dup_tag == dd_worse) { // entries only get better, no need to look
+					dup_tags_trusted++;
+					this->res.dups++;
+					release(successor);
+					continue;
+				}
+				// Trust the worker's probe unless a write since may have changed its answer.
+				HeapNode<Node, NodeComp> * dup_hn;
+				if (successor->dup_tag == dd_new && closed.unchanged_since(successor->hash, successor->probed)) {
+					dup_tags_trusted++;
+					dup_hn = nullptr;
+				} else {
+					if (successor->dup_tag == dd_new)
+						dup_rechecks++;
+					dup_hn = closed.find(successor, successor->hash);
+				}
+				if (dup_hn) { // if its in closed, check if dup is better
 					Node &dup = dup_hn->search_node;
 					this->res.dups++;
 					if (kid->g >= dup.g) { // kid is worse so don't bother
-						// nodes->destruct(kid);
+						release(successor);
 						continue;
 					}
-					open.decrease_key(dup_hn->handle, successor);
-					closed[kid->state] = successor;
+					closed.assign(successor);
+					if (open.contains(dup_hn)) {
+						open.decrease_key(dup_hn->handle, successor);
+						release(dup_hn);
+					} else { // dup was expanded, its children still point at it
+						this->res.reopnd++;
+						open.push(successor);
+					}
 				}
 				else{
 					open.push(successor); // add to open list
-					closed[kid->state] = successor; // add to closed list
+					closed.insert(successor); // add to closed list
 				}
-
-				// if (wasSpec){
-				// 	// add to speculated node delays
-				// 	speculated_node_delays[SearchAlgorithm<D>::res.expd - kid->nodes_expanded_at_time_of_expansion]++;
-				// }
-				// else{
-				// 	// add to node delays
-				// 	if(kid->parent == nullptr){
-				// 		node_delays[0]++;
-				// 	}
-				// 	else{
-				// 		node_delays[SearchAlgorithm<D>::res.expd - kid->nodes_expanded_at_time_of_expansion]++;
-				// 	}
-				// }
 			}
 			// long double sum = 0;
 			// for(size_t i = 0; i < 10; i++){
 			// 	sum = sin(sum + rand());
 			// }
 			// total_sum += sum;
+
+			if (SearchAlgorithm<D>::res.expd % RECLAIM_INTERVAL == 0){
+				reclaimer.collect(node_pools);
+			}
+			if (tune_windows && num_threads > 1 && SearchAlgorithm<D>::res.expd % WINDOW_TUNE_INTERVAL == 0){
+				tuner.update(open, prec_expanded_source, total_nodes_speculated.load(std::memory_order_relaxed), speculated_nodes_expanded);
+			}
 		}
 		this->finish();
 	}
@@ -397,10 +481,85 @@ template <class D> struct CAFE : public SearchAlgorithm<D> {
 		// closed.prstats(stdout, "closed ");
 		dfpair(stdout, "open list type", "%s", "closed");
 		dfpair(stdout, "node size", "%u", sizeof(Node));
+		dfpair(stdout, "open list arity", "%u", CAFE_HEAP_ARITY);
+		std::size_t nested = 0;
+		for (auto& wm : wmdat)
+			nested += wm.nested;
+		double wall = this->res.wallend - this->res.wallstart;
+		if (wall > 0) {
+			dfpair(stdout, "expansion rate", "%g", this->res.expd / wall);
+			dfpair(stdout, "total expansion rate", "%g", (manual_expansions + total_nodes_speculated.load() + nested) / wall);
+		}
+		if (!cpus.empty()) {
+			std::string pinned;
+			for (std::size_t i = 0; i < num_threads; i++)
+				pinned += (i > 0 ? "," : "") + std::to_string(cpus[i % cpus.size()]);
+			dfpair(stdout, "pinned cpus", "%s", pinned.c_str());
+		}
+		std::size_t pooled = 0, reused = 0;
+		for (auto& pool : node_pools){
+			pooled += pool.size();
+			reused += pool.reused();
+		}
+		dfpair(stdout, "capacity", "%lu", capacity);
+		dfpair(stdout, "pool nodes allocated", "%lu", pooled);
+		dfpair(stdout, "pool blocks reused", "%lu", reused);
+		std::size_t stopped = 0;
+		for (auto& wm : wmdat)
+			stopped += wm.pool_full;
+		dfpair(stdout, "workers stopped on full pool", "%lu", stopped);
+		dfpair(stdout, "final top window", "%u", open.top_window());
+		dfpair(stdout, "final recent window", "%u", open.recent_window());
+		dfpair(stdout, "window resizes", "%lu", tuner.resizes());
+		std::size_t parks = 0;
+		double parked_seconds = 0;
+		for (auto& wm : wmdat) {
+			parks += wm.parks;
+			parked_seconds += wm.parked_seconds;
+		}
+		dfpair(stdout, "worker parks", "%lu", parks);
+		dfpair(stdout, "worker parked time", "%g", parked_seconds);
+		dfpair(stdout, "worker wakeups", "%lu", open.wakeups());
+		dfpair(stdout, "nested expansions", "%lu", nested);
+		dfpair(stdout, "nested expansions used", "%lu", nested_used);
+		dfpair(stdout, "dup tags trusted", "%lu", dup_tags_trusted);
+		dfpair(stdout, "dup tags rechecked", "%lu", dup_rechecks);
+		if (record_delays) {
+			LogHistogram speculated_delays;
+			for (auto& wm : wmdat)
+				speculated_delays.add(wm.delays);
+			dfdelays(out, "speculated delay", speculated_delays);
+			dfdelays(out, "manual delay", manual_delays);
+		}
+	}
+
+	// dfdelays writes the non-empty buckets of a delay histogram as
+	// datafile pairs keyed by their range of expansions.
+	static void dfdelays(FILE *out, const char *name, const LogHistogram &h) {
+		dfpair(out, (std::string(name) + " count").c_str(), "%lu", h.total());
+		for (std::size_t i = 0; i < LogHistogram::n_buckets; i++) {
+			if (h.buckets[i] == 0)
+				continue;
+			std::string key = std::string(name) + " [" + std::to_string(LogHistogram::lower(i)) +
+				"," + std::to_string(LogHistogram::upper(i)) + ")";
+			dfpair(out, key.c_str(), "%lu", h.buckets[i]);
+		}
 	}
 
 private:
+	// StopOnExit stops the workers however search returns, before
+	// their jthreads are joined.
+	struct StopOnExit {
+		std::stop_source &src;
+		OpenList &open;
+		~StopOnExit() {
+			src.request_stop();
+			open.wake_all();
+		}
+	};
+
 	size_t num_threads;
+	size_t capacity;
 	std::atomic<size_t> total_nodes_observed = 0;
 	std::atomic<size_t> total_nodes_speculated = 0;
 
@@ -416,28 +575,124 @@ private:
 	long double total_sum = 0;
 
 	size_t extra_calcs = 0;
+	size_t manual_expansions = 0; // expansions done by the main thread itself
 
 	std::vector<WorkerMetadata> wmdat;
 
-	// make atomic vector of size 1 million all set to 0
-	std::vector<size_t> node_delays = std::vector<size_t>(OPEN_LIST_SIZE, 0);
-	std::vector<size_t> speculated_node_delays = std::vector<size_t>(OPEN_LIST_SIZE, 0);
+	bool tune_windows = true; // -fixedwin keeps the initial window sizes
+	bool park_idle = true; // -spin keeps idle workers busy-waiting
+	bool speculate_dups = true; // -nospecdd leaves all duplicate detection to the main thread
+	std::size_t dup_tags_trusted = 0; // speculated children adopted without probing closed
+	std::size_t dup_rechecks = 0;     // speculated children whose tag went stale
+	WindowTuner tuner;
+
+	// Expansion delay histograms, only filled with -hist.
+	bool record_delays = false;
+	std::atomic<std::uint32_t> expansion_clock = 0;
+	LogHistogram manual_delays;
 
-	
 
 	std::vector<NodePool<Node, NodeComp>> node_pools;
-	std::pair<HeapNode<Node, NodeComp> *, std::size_t> expand(D& d, HeapNode<Node, NodeComp> * hn, NodePool<Node, NodeComp> &nodes, State& state) {
+	EpochReclaimer<Node, NodeComp> reclaimer;
+
+	// -depth2 k has a worker also expand the k best children of each node
+	// it expands, so their successors are ready when the main thread gets
+	// to them.
+	std::size_t depth2 = 0;
+	std::size_t nested_used = 0; // nested expansions the main thread adopted
+
+	// expand_best expands up to depth2 of a fresh, unpublished block's
+	// best children in place.  Worse duplicates are skipped, the main
+	// thread will drop them.
+	void expand_best(D &d, HeapNode<Node, NodeComp> * kids, std::size_t n, NodePool<Node, NodeComp> &nodes, WorkerMetadata& wm) {
+		HeapNode<Node, NodeComp> * best[DEPTH2_MAX];
+		std::size_t nbest = 0;
+		for (std::size_t i = 0; i < n; i++) {
+			if (kids[i].dup_tag == dd_worse)
+				continue;
+			std::size_t j = nbest < depth2 ? nbest++ : depth2;
+			for (; j > 0 && NodeComp()(kids[i].search_node, best[j-1]->search_node); j--) {
+				if (j < depth2)
+					best[j] = best[j-1];
+			}
+			if (j < depth2)
+				best[j] = &kids[i];
+		}
+		for (std::size_t i = 0; i < nbest; i++) {
+			State buf, &state = d.unpack(buf, best[i]->search_node.state);
+			auto r = expand(d, best[i], nodes, state, speculate_dups);
+			waste_time(extra_calcs);
+			best[i]->reserve(); // keep other workers off it
+			best[i]->ee = ExpansionEntry(WorkerState::nested, 0);
+			best[i]->set_completed(r.first, r.second);
+			wm.nested++;
+		}
+	}
+
+	// drop_unpublished gives a worker's block that was never published,
+	// and the -depth2 blocks hanging off it, straight back to its pool.
+	void drop_unpublished(NodePool<Node, NodeComp> &nodes, HeapNode<Node, NodeComp> * block, std::size_t n) {
+		for (std::size_t i = 0; i < n; i++) {
+			auto nested = block[i].claim();
+			if (nested.second > 0)
+				nodes.release(nested.first);
+		}
+		nodes.release(block);
+	}
+
+	// -pin cpus, thread i (0 is the main thread) runs on cpus[i % cpus.size()].
+	// List the main thread's socket first to keep it with its first workers.
+	std::vector<unsigned int> cpus;
+
+	// place_thread pins the calling thread, if asked to, then touches the
+	// start of its pool from there so the pages land on its NUMA node.
+	void place_thread(std::size_t i, NodePool<Node, NodeComp> &nodes) {
+		if (!cpus.empty() && !pinthread(cpus[i % cpus.size()]))
+			warn("Failed to pin thread %lu to cpu %u", i, cpus[i % cpus.size()]);
+		nodes.prefault(std::min<std::size_t>(PREFAULT_NODES, capacity));
+	}
+
+	// release drops a node the search no longer references.  Its block goes
+	// back to its pool once every node in it is dead and no worker can see it.
+	void release(HeapNode<Node, NodeComp> * hn) {
+		open.forget(hn);
+		auto spec = hn->claim();
+		if (spec.second > 0) { // speculated successors that will never be adopted
+			for (std::size_t i = 0; i < spec.second; i++) { // and their -depth2 blocks
+				auto nested = spec.first[i].claim();
+				if (nested.second > 0)
+					reclaimer.retire(nested.first);
+			}
+			reclaimer.retire(spec.first);
+		}
+		HeapNode<Node, NodeComp> * block = hn - hn->block_ofs;
+		if (--block->block_live == 0)
+			reclaimer.retire(block);
+	}
+
+	// expand generates hn's children and hashes their states.  With probe
+	// set (on workers) each child is also tagged from a look in closed.
+	std::pair<HeapNode<Node, NodeComp> *, std::size_t> expand(D& d, HeapNode<Node, NodeComp> * hn, NodePool<Node, NodeComp> &nodes, State& state, bool probe) {
 		// auto start = std::chrono::high_resolution_clock::now();
 		Node * n = &(hn->search_node);
 
 		typename D::Operators ops(d, state);
-		auto successors = nodes.reserve(ops.size());
+		size_t nkids = 0;
+		for (unsigned int i = 0; i < ops.size(); i++) {
+			if (ops[i] != n->pop)
+				nkids++;
+		}
+		auto successors = nodes.reserve(nkids);
 		size_t successor_count = 0;
+		std::uint32_t version = probe ? closed.version() : 0;
+		// expand runs on the main thread and on the workers
+		static thread_local HeuristicBatch<D, Node> hbatch;
 
 		for (unsigned int i = 0; i < ops.size(); i++) {
 			if (ops[i] == n->pop)
 				continue;
 
+			successors[successor_count].zero();
 			Node * kid = &(successors[successor_count].search_node);	
 			assert (kid != nullptr);
 			successor_count++;
@@ -446,15 +701,25 @@ private:
 			kid->g = n->g + e.cost;
 			d.pack(kid->state, e.state);
 
-			kid->f = kid->g + d.h(e.state);
+			hbatch.add(d, e.state, kid, [](Node*, Cost) { });
 			kid->parent = n;
 			kid->op = ops[i];
 			kid->pop = e.revop;
-			// kid->nodes_expanded_at_time_of_expansion = SearchAlgorithm<D>::res.expd;
-			// std::cerr << kid->nodes_expanded_at_time_of_expansion - n->nodes_expanded_at_time_of_expansion << std::endl;
-			// node_delays[kid->nodes_expanded_at_time_of_expansion - n->nodes_expanded_at_time_of_expansion]++;
 			total_nodes_observed++; // generated
+
+			HeapNode<Node, NodeComp> &skid = successors[successor_count-1];
+			skid.hash = Closed::fold(StateHasher()(kid->state));
+			skid.probed = version;
+			skid.dup_tag = dd_unknown;
+			if (probe) {
+				auto dup = closed.find(&skid, skid.hash);
+				if (dup == nullptr)
+					skid.dup_tag = dd_new;
+				else
+					skid.dup_tag = kid->g >= dup->search_node.g ? dd_worse : dd_better;
+			}
 		}
+		hbatch.flush(d, [](Node*, Cost) { });
 		
 		// long double sum = 0;
 		// for(size_t i = 0; i < extra_calcs; i++){
@@ -472,9 +737,12 @@ private:
 	HeapNode<Node, NodeComp> * init(D &d, NodePool<Node, NodeComp> &nodes, State &s0) {
 		HeapNode<Node, NodeComp> * hn0 = nodes.reserve(1);
 		hn0->zero();
+		hn0->born = 0;
+		hn0->dup_tag = dd_unknown;
 		//hn0->mark_fresh();
 		Node* n0 = &(hn0->search_node);
 		d.pack(n0->state, s0);
+		hn0->hash = Closed::fold(StateHasher()(n0->state));
 		n0->g = Cost(0);
 		n0->f = d.h(s0);
 		n0->pop = n0->op = D::Nop;
@@ -482,6 +750,6 @@ private:
 		return hn0;
 	}
 
-	CafeMinBinaryHeap<Node, NodeComp> open;
-	boost::unordered_flat_map<PackedState, HeapNode<Node, NodeComp> *, StateHasher, StateEq> closed;
+	OpenList open;
+	Closed closed;
 };
@@ -1,52 +1,102 @@
 // Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <typeinfo>
 #include <cstring>
+#include <new>
 #include <string>
+#include <vector>
 
 void dfpair(FILE *, const char *key, const char *fmt, ...);	// utils.hpp
+double walltime();	// utils.hpp
 
 enum { FillFact = 0 };
 
+// ClosedList is a ChainedClosedList, or an OpenClosedList when built
+// with -DCLOSED_OPEN_ADDRESSING (see the Makefile).  The open addressing
+// table needs no link in the nodes, so their ClosedEntry is empty.
+#ifndef CLOSED_OPEN_ADDRESSING
+
 template<typename Node, typename D> struct ClosedEntry {
 	ClosedEntry() : nxt(NULL) { }
 	Node *nxt;
+#ifdef CLOSED_CACHE_HASH
+	unsigned long hash;	// saves rehashing the node when the table grows
+#endif
+};
+
+template<typename Ops, typename Node, typename D> struct ChainedClosedList;
+template<typename Ops, typename Node, typename D> using ClosedList = ChainedClosedList<Ops, Node, D>;
+
+#else
+
+template<typename Node, typename D> struct ClosedEntry {
 };
 
-template<typename Ops, typename Node, typename D> struct ClosedList {
+template<typename Ops, typename Node, typename D> struct OpenClosedList;
+template<typename Ops, typename Node, typename D> using ClosedList = OpenClosedList<Ops, Node, D>;
+
+#endif
+
+// A ChainedClosedList is a hash table that chains the nodes of each
+// bin through their ClosedEntry.  It grows incrementally: a resize
+// only allocates the new bins, and each later add moves a few of the
+// old bins across, so no single add rehashes the whole table.
+//
+// The size hint is a reservation.  The bins come zeroed from calloc,
+// which maps large blocks straight from the kernel, so their pages
+// take memory only once a node lands in them.  A domain with a
+// nstates() method bounds the number of distinct states, and init
+// shrinks the table to suit.
+template<typename Ops, typename Node, typename D> struct ChainedClosedList {
 
 	enum {
 		Defsz = 1024,
-		Growfact = 2,
+		Growfact = 2,	// must be 2, see migrate
 		Fillfact = 3,
+		Migrate = 4,	// old bins moved per add while growing
 	};
 
 	typedef typename D::PackedState PackedState;
 
-	ClosedList(unsigned long szhint) :
-			fill(0), ncollide(0), nresize(0), nbins(0), fills(NULL), bins(NULL) {
-		resize(szhint);
-		nresize = 0;	// don't count the initial resize
+	ChainedClosedList(unsigned long szhint) :
+			fill(0), ncollide(0), nresize(0), nbins(0), onbins(0), mig(0),
+			maxpause(0), fills(NULL), ofills(NULL), bins(NULL), obins(NULL) {
+		alloc(szhint);
 	}
 
-	~ClosedList() {
-		if (bins)
-			delete []bins;
-		if (fills)
-			delete []fills;
+	~ChainedClosedList() {
+		free(bins);
+		free(fills);
+		free(obins);
+		free(ofills);
 	}
 
-	void init(D &d) { dom = &d; }
+	void init(D &d) {
+		dom = &d;
+		if constexpr (requires { d.nstates(); }) {
+			unsigned long sz = (unsigned long) d.nstates() * Fillfact + 1;
+			if (fill == 0 && !obins && sz < nbins)
+				alloc(sz);
+		}
+	}
 
+	// clear empties the table, keeping its size.  The bins are
+	// allocated anew rather than zeroed, so that only the pages
+	// touched afterwards take memory.
 	void clear() {
+		free(obins);
+		free(ofills);
+		obins = NULL;
+		ofills = NULL;
 		fill = ncollide = 0;
 		nresize = 0;
-		for (unsigned int i = 0; i < nbins; i++) {
-			bins[i] = NULL;
-			fills[i] = 0;
-		}
+		maxpause = 0;
+		alloc(nbins);
 	}
 
 	void add(Node *n) {
@@ -54,10 +104,17 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 	}
 
 	void add(Node *n, unsigned long h) {
+		if (obins)
+			migrate(Migrate);
 		if (fill * Fillfact >= nbins)
 			resize(nbins == 0 ? Defsz : nbins * Growfact);
 
-		add(bins, fills, nbins, n, h);
+#ifdef CLOSED_CACHE_HASH
+		Ops::closedentry(n).hash = h;
+#endif
+		unsigned int *f;
+		Node **b = head(h, &f);
+		push(b, f, n);
 		fill++;
 	}
 
@@ -66,7 +123,11 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 	}
 
 	Node *find(PackedState &k, unsigned long h) {
-		for (Node *p = bins[h % nbins]; p; p = Ops::closedentry(p).nxt) {
+		for (Node *p = *head(h); p; p = Ops::closedentry(p).nxt) {
+#ifdef CLOSED_CACHE_HASH
+			if (Ops::closedentry(p).hash != h)
+				continue;
+#endif
 			if (Ops::key(p).eq(dom, k))
 				return p;
 		}
@@ -75,6 +136,28 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 	}
 
 	void prstats(FILE *out, const char *prefix) {
+		prstats(out, prefix, std::vector<ChainedClosedList*>(1, this));
+	}
+
+	// prstats writes the statistics of the partitions of one closed
+	// list, the counts summed and the maxima over all of them.
+	static void prstats(FILE *out, const char *prefix, const std::vector<ChainedClosedList*> &parts) {
+		unsigned long fill = 0, ncollide = 0, nresize = 0, nbins = 0;
+		double maxpause = 0;
+		unsigned int m = 0;
+		for (ChainedClosedList *t : parts) {
+			// the new bins that were not moved to yet hold garbage
+			if (t->obins)
+				t->migrate(t->onbins);
+			fill += t->fill;
+			ncollide += t->ncollide;
+			nresize += t->nresize;
+			nbins += t->nbins;
+			maxpause = std::max(maxpause, t->maxpause);
+			for (unsigned int i = 0; i < t->nbins; i++)
+				m = std::max(m, t->fills[i]);
+		}
+
 		dfpair(out, "closed list type", "%s", "hash table");
 
 		std::string key = prefix + std::string("fill");
@@ -86,12 +169,12 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 		key = prefix + std::string("resizes");
 		dfpair(out, key.c_str(), "%lu", nresize);
 
+		key = prefix + std::string("max resize pause");
+		dfpair(out, key.c_str(), "%g", maxpause);
+
 		key = prefix + std::string("buckets");
 		dfpair(out, key.c_str(), "%lu", nbins);
 
-		unsigned int m = 0;
-		for (unsigned int i = 0; i < nbins; i++)
-			m = std::max(m, fills[i]);
 		key = prefix + std::string("max bucket fill");
 		dfpair(out, key.c_str(), "%u", m);
 	}
@@ -101,24 +184,15 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 	}
 
 	Node* remove(PackedState &k, unsigned long h) {
-		unsigned int bindex = h % this->nbins;
-		Node* prev = this->bins[bindex];
-		Node *p = prev;
-		for ( ; p; p = Ops::closedentry(p).nxt) {
-			if (Ops::key(p).eq(dom, k)) break;
-			prev = p;
-		}
-
-		if(!p) return NULL;
-
-		this->fill--;
-		if(prev == p) { //head of the list
-			this->bins[bindex] = Ops::closedentry(p).nxt;
-		}
-		else { // middle or tail
-			Ops::closedentry(prev).nxt = Ops::closedentry(p).nxt;
+		for (Node **pp = head(h); *pp; pp = &Ops::closedentry(*pp).nxt) {
+			Node *p = *pp;
+			if (Ops::key(p).eq(dom, k)) {
+				*pp = Ops::closedentry(p).nxt;
+				this->fill--;
+				return p;
+			}
 		}
-		return p;
+		return NULL;
 	}
 
 	class iterator {
@@ -187,7 +261,11 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 		unsigned int nbins;
 	};
 
+	// begin finishes any growth in progress, as the iterator only
+	// walks one set of bins.
 	iterator begin() {
+		if (obins)
+			migrate(onbins);
 		return iterator::begin(bins, nbins);
 	}
 
@@ -203,49 +281,441 @@ template<typename Ops, typename Node, typename D> struct ClosedList {
 		return this->fill == 0;
 	}
 
+	// resize grows the table to sz bins.  Doubling the size keeps
+	// the old bins and moves them over a few at a time, any other
+	// size rehashes everything now.  The time spent is the longest
+	// the search waits on the table, which prstats reports.
 	void resize(unsigned int sz) {
-		Node **b = new Node*[sz];
-		unsigned int *f = new unsigned int[sz];
+		double strt = walltime();
+		if (obins)
+			migrate(onbins);
+
+		if (nbins > 0 && sz == nbins * Growfact) {
+			obins = bins;
+			ofills = fills;
+			onbins = nbins;
+			mig = 0;
+			// cleared by migrate
+			bins = mem<Node*>(sz, false);
+			fills = mem<unsigned int>(sz, false);
+			nbins = sz;
+		} else {
+			Node **b = mem<Node*>(sz, true);
+			unsigned int *f = mem<unsigned int>(sz, true);
+
+			for (unsigned int i = 0; i < nbins; i++) {
+				Node *nxt = NULL;
+				for (Node *p = bins[i]; p; p = nxt) {
+					nxt = Ops::closedentry(p).nxt;
+					unsigned int j = hashof(p) % sz;
+					push(b + j, f + j, p);
+				}
+			}
+
+			free(bins);
+			free(fills);
 
-		for (unsigned int i = 0; i < sz; i++) {
-			b[i] = NULL;
-			f[i] = 0;
+			bins = b;
+			fills = f;
+			nbins = sz;
 		}
+		nresize++;
+		maxpause = std::max(maxpause, walltime() - strt);
+	}
+
+private:
+	friend class iterator;
 
-		for (unsigned int i = 0; i < nbins; i++) {
+	// head returns the head of h's chain, in the old bins if its
+	// old bin has not moved yet, and sets *f to its fill count.
+	Node **head(unsigned long h, unsigned int **f = NULL) {
+		unsigned long i;
+		if (obins) {
+			// one division gives both the old and the new bin
+			unsigned long q = h / onbins;
+			i = h - q * onbins;
+			if (i >= mig) {
+				if (f)
+					*f = ofills + i;
+				return obins + i;
+			}
+			i += (q & 1) * onbins;
+		} else {
+			i = h % nbins;
+		}
+		if (f)
+			*f = fills + i;
+		return bins + i;
+	}
+
+	void push(Node **b, unsigned int *f, Node *e) {
+		if (*b)
+			ncollide++;
+		Ops::closedentry(e).nxt = *b;
+		*b = e;
+		(*f)++;
+	}
+
+	// migrate moves up to k of the old bins into the new ones.  As
+	// the table doubled, old bin i splits into new bins i and
+	// i+onbins, and nothing is added to those until bin i moves, so
+	// they are cleared here instead of when they are allocated.
+	void migrate(unsigned int k) {
+		for ( ; k > 0 && mig < onbins; k--, mig++) {
+			bins[mig] = bins[mig + onbins] = NULL;
+			fills[mig] = fills[mig + onbins] = 0;
 			Node *nxt = NULL;
-			for (Node *p = bins[i]; p; p = nxt) {
+			for (Node *p = obins[mig]; p; p = nxt) {
 				nxt = Ops::closedentry(p).nxt;
-				add(b, f, sz, p, Ops::key(p).hash(dom));
+				unsigned int j = hashof(p) % nbins;
+				push(bins + j, fills + j, p);
 			}
 		}
+		if (mig < onbins)
+			return;
+		free(obins);
+		free(ofills);
+		obins = NULL;
+		ofills = NULL;
+	}
 
-		if (bins)
-			delete[] bins;
-		if (fills)
-			delete []fills;
-
-		bins = b;
-		fills = f;
+	// alloc replaces the bins of the empty table with sz zeroed
+	// ones.
+	void alloc(unsigned long sz) {
+		free(bins);
+		free(fills);
+		bins = mem<Node*>(sz, true);
+		fills = mem<unsigned int>(sz, true);
 		nbins = sz;
+	}
+
+	template<typename T> static T *mem(unsigned long n, bool zero) {
+		T *p = (T*) (zero ? calloc(n, sizeof(T)) : malloc(n * sizeof(T)));
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	unsigned long hashof(Node *p) {
+#ifdef CLOSED_CACHE_HASH
+		return Ops::closedentry(p).hash;
+#else
+		return Ops::key(p).hash(dom);
+#endif
+	}
+
+	D *dom;
+	unsigned long fill, ncollide;
+	unsigned int nresize, nbins;
+	unsigned int onbins, mig;	// old bins below mig have moved
+	double maxpause;
+	unsigned int *fills, *ofills;
+	Node **bins, **obins;
+};
+
+// An OpenClosedList is an open addressing hash table in the manner of
+// a Swiss table.  The slots come in groups of eight, and each slot has
+// a control byte that holds seven bits of its node's hash, or marks it
+// empty or deleted.  A lookup compares the fingerprint against a whole
+// group of control bytes in one word, so it only touches the nodes
+// whose fingerprint matches.  Like ChainedClosedList, the home group is
+// the hash modulo an odd number of groups, as some domains hash to the
+// packed state itself, and the following groups are probed in turn.
+// Only the control bytes are written when the table is allocated, so
+// the slots of a large size hint take memory as they fill, and init
+// shrinks the table for domains with nstates(), as ChainedClosedList
+// does.
+template<typename Ops, typename Node, typename D> struct OpenClosedList {
+
+	typedef typename D::PackedState PackedState;
+
+	enum {
+		Group = 8,
+		Empty = 0x80,
+		Deleted = 0xFE,
+	};
+
+	OpenClosedList(unsigned long szhint) :
+			fill(0), ndead(0), ncollide(0), nresize(0), maxprobe(0),
+			ngroups(0), nbins(0), maxpause(0), ctrl(NULL), slots(NULL) {
+		alloc((szhint + Group - 1) / Group | 1);
+	}
+
+	~OpenClosedList() {
+		if (ctrl)
+			delete[] ctrl;
+		if (slots)
+			delete[] slots;
+	}
+
+	void init(D &d) {
+		dom = &d;
+		if constexpr (requires { d.nstates(); }) {
+			unsigned long ng = ((unsigned long) d.nstates() * 8 / 7 + Group) / Group | 1;
+			if (fill == 0 && ndead == 0 && ng < ngroups) {
+				delete[] ctrl;
+				delete[] slots;
+				alloc(ng);
+			}
+		}
+	}
+
+	void clear() {
+		memset(ctrl, Empty, nbins);
+		fill = ndead = ncollide = 0;
+		nresize = maxprobe = 0;
+		maxpause = 0;
+	}
+
+	void add(Node *n) {
+		add(n, Ops::key(n).hash(dom));
+	}
+
+	void add(Node *n, unsigned long h) {
+		// Deleted slots lengthen probes like full ones, so they
+		// count against the load.  Mostly deleted tables are
+		// rehashed at the same size.
+		if ((fill + ndead + 1) * 8 > nbins * 7)
+			resize(fill * 16 >= nbins * 7 ? ngroups * 2 + 1 : ngroups);
+		put(n, h);
+	}
+
+	Node *find(PackedState &k) {
+		return find(k, k.hash(dom));
+	}
+
+	Node *find(PackedState &k, unsigned long h) {
+		unsigned long i = slot(k, h);
+		return i < nbins ? slots[i] : NULL;
+	}
+
+	Node *remove(PackedState &k) {
+		return remove(k, k.hash(dom));
+	}
+
+	Node *remove(PackedState &k, unsigned long h) {
+		unsigned long i = slot(k, h);
+		if (i >= nbins)
+			return NULL;
+		// No probe ever passed a group with an empty slot,
+		// so the slot can be made empty again.
+		if (matchempty(group(i / Group))) {
+			ctrl[i] = Empty;
+		} else {
+			ctrl[i] = Deleted;
+			ndead++;
+		}
+		fill--;
+		return slots[i];
+	}
+
+	void prstats(FILE *out, const char *prefix) {
+		prstats(out, prefix, std::vector<OpenClosedList*>(1, this));
+	}
+
+	// prstats writes the statistics of the partitions of one closed
+	// list, as ChainedClosedList's does.
+	static void prstats(FILE *out, const char *prefix, const std::vector<OpenClosedList*> &parts) {
+		unsigned long fill = 0, ncollide = 0, nresize = 0, nbins = 0, maxprobe = 0;
+		double maxpause = 0;
+		for (OpenClosedList *t : parts) {
+			fill += t->fill;
+			ncollide += t->ncollide;
+			nresize += t->nresize;
+			nbins += t->nbins;
+			maxprobe = std::max(maxprobe, t->maxprobe);
+			maxpause = std::max(maxpause, t->maxpause);
+		}
+
+		dfpair(out, "closed list type", "%s", "open addressing");
+
+		std::string key = prefix + std::string("fill");
+		dfpair(out, key.c_str(), "%lu", fill);
+
+		key = prefix + std::string("collisions");
+		dfpair(out, key.c_str(), "%lu", ncollide);
+
+		key = prefix + std::string("resizes");
+		dfpair(out, key.c_str(), "%lu", nresize);
+
+		key = prefix + std::string("max resize pause");
+		dfpair(out, key.c_str(), "%g", maxpause);
+
+		key = prefix + std::string("buckets");
+		dfpair(out, key.c_str(), "%lu", nbins);
+
+		key = prefix + std::string("max probe groups");
+		dfpair(out, key.c_str(), "%lu", maxprobe);
+	}
+
+	class iterator {
+	public:
+		iterator(const OpenClosedList *t, unsigned long i) : tbl(t), ind(i) {
+			skip();
+		}
+
+		bool operator==(const iterator &o) const {
+			return ind == o.ind;
+		}
+
+		bool operator!=(const iterator &o) const {
+			return !(*this == o);
+		}
+
+		Node *operator*() const {
+			return tbl->slots[ind];
+		}
+
+		void operator++() {
+			ind++;
+			skip();
+		}
+
+	private:
+		void skip() {
+			while (ind < tbl->nbins && tbl->ctrl[ind] >= Empty)
+				ind++;
+		}
+
+		const OpenClosedList *tbl;
+		unsigned long ind;
+	};
+
+	iterator begin() {
+		return iterator(this, 0);
+	}
+
+	iterator end() {
+		return iterator(this, nbins);
+	}
+
+	unsigned long getFill() const {
+		return fill;
+	}
+
+	bool empty() const {
+		return fill == 0;
+	}
+
+	// resize rehashes the table into the given number of groups.
+	// Unlike ChainedClosedList it does so all at once.
+	void resize(unsigned long ng) {
+		double strt = walltime();
+		uint8_t *oc = ctrl;
+		Node **os = slots;
+		unsigned long on = nbins;
+
+		// the collisions and probes of adds, not of rehashes
+		unsigned long nc = ncollide, mp = maxprobe;
+		alloc(ng);
+		for (unsigned long i = 0; i < on; i++) {
+			if (oc[i] < Empty)
+				put(os[i], Ops::key(os[i]).hash(dom));
+		}
+		ncollide = nc;
+		maxprobe = mp;
+
+		delete[] oc;
+		delete[] os;
 		nresize++;
+		maxpause = std::max(maxpause, walltime() - strt);
 	}
 
 private:
 	friend class iterator;
 
-	void add(Node *b[], unsigned int f[], unsigned int n, Node *e, unsigned long h) {
-		unsigned int i = h % n;
-		if (b[i])
-			ncollide++;
-		Ops::closedentry(e).nxt = b[i];
-		b[i] = e;
-		f[i]++;
+	static const uint64_t Lo = 0x0101010101010101ull;
+	static const uint64_t Hi = 0x8080808080808080ull;
+
+	// fingerprint mixes the hash, which for some domains is the
+	// packed state itself, down to seven bits.
+	static uint64_t fingerprint(uint64_t h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return h & 0x7F;
+	}
+
+	void alloc(unsigned long ng) {
+		ngroups = ng;
+		nbins = ng * Group;
+		ctrl = new uint8_t[nbins];
+		slots = new Node*[nbins];	// only read where ctrl is full
+		memset(ctrl, Empty, nbins);
+		fill = ndead = 0;
+	}
+
+	// group returns the control bytes of group g as a word, the
+	// first slot in the low byte.
+	uint64_t group(unsigned long g) const {
+		uint64_t w;
+		memcpy(&w, ctrl + g * Group, sizeof(w));
+		return w;
+	}
+
+	// The match functions return a word with the high bit set in
+	// each byte that matches.  matchfp may also flag a full slot
+	// that does not match, which costs an extra comparison.
+	static uint64_t matchfp(uint64_t w, uint64_t fp) {
+		uint64_t x = w ^ (Lo * fp);
+		return (x - Lo) & ~x & Hi;
+	}
+
+	static uint64_t matchempty(uint64_t w) {
+		return w & ~(w << 6) & Hi;
+	}
+
+	static uint64_t matchfree(uint64_t w) {
+		return w & Hi;
+	}
+
+	static unsigned int firstbyte(uint64_t m) {
+		return __builtin_ctzll(m) / 8;
+	}
+
+	// slot returns the slot holding k, or nbins if there is none.
+	unsigned long slot(PackedState &k, unsigned long h) const {
+		uint64_t fp = fingerprint(h);
+		unsigned long g = h % ngroups;
+		for ( ; ; ) {
+			uint64_t w = group(g);
+			for (uint64_t hits = matchfp(w, fp); hits; hits &= hits - 1) {
+				unsigned long s = g * Group + firstbyte(hits);
+				if (Ops::key(slots[s]).eq(dom, k))
+					return s;
+			}
+			if (matchempty(w))
+				return nbins;
+			if (++g == ngroups)
+				g = 0;
+		}
+	}
+
+	void put(Node *n, unsigned long h) {
+		unsigned long g = h % ngroups;
+		for (unsigned long i = 1; ; i++) {
+			uint64_t free = matchfree(group(g));
+			if (free) {
+				unsigned long s = g * Group + firstbyte(free);
+				if (ctrl[s] == Deleted)
+					ndead--;
+				ctrl[s] = fingerprint(h);
+				slots[s] = n;
+				fill++;
+				if (i > 1)
+					ncollide++;
+				maxprobe = std::max(maxprobe, i);
+				return;
+			}
+			if (++g == ngroups)
+				g = 0;
+		}
 	}
 
 	D *dom;
-	unsigned long fill, ncollide;
-	unsigned int nresize, nbins;
-	unsigned int *fills;
-	Node** bins;
+	unsigned long fill, ndead, ncollide, nresize, maxprobe;
+	unsigned long ngroups, nbins;
+	double maxpause;
+	uint8_t *ctrl;
+	Node **slots;
 };
@@ -67,7 +67,7 @@ private:
 		Node() : expd(false) {
 		}
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 	};
 
 	class Nodes {
@@ -160,7 +160,7 @@ private:
 		bool closed;
 
 	private:
-		ClosedEntry<LssNode, D> nodesent;
+		[[no_unique_address]] ClosedEntry<LssNode, D> nodesent;
 	};
 
 public:
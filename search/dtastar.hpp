@@ -115,7 +115,7 @@ private:
 			Node() : expd(false) {
 			}
 
-			ClosedEntry<Node, D> closedEnt;
+			[[no_unique_address]] ClosedEntry<Node, D> closedEnt;
 		};
 
 		static PackedState &key(Node *n) {
@@ -204,7 +204,7 @@ private:
 			Node() : openind(-1), learnind(-1), closed(false), updated(false) {
 			}
 
-			ClosedEntry<Node, D> closedEnt;
+			[[no_unique_address]] ClosedEntry<Node, D> closedEnt;
 		};
 
 		static PackedState &key(Node *n) {
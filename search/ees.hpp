@@ -13,7 +13,7 @@ template <class D> struct EES : public SearchAlgorithm<D> {
 
 	struct Node {
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 
 		// values for tracking location in focal, open, and f-ordered list
 		bool open;
@@ -66,7 +66,7 @@ private:
 		Node() : gglobal(geom2d::Infinity), dead(false), expd(false) {
 		}
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 	};
 
 	class Nodes {
@@ -167,7 +167,7 @@ private:
 		bool updated;
 
 	private:
-		ClosedEntry<AstarNode, D> closedent, nodesent;
+		[[no_unique_address]] ClosedEntry<AstarNode, D> closedent, nodesent;
 	};
 
 public:
@@ -10,7 +10,7 @@ template <class D, bool speedy = false> struct Greedy : public SearchAlgorithm<D
 	typedef typename D::Oper Oper;
 
 	struct Node {
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 		int openind;
 		Node *parent;
 		PackedState state;
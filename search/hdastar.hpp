@@ -0,0 +1,392 @@
+// Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+#pragma once
+#include "../search/search.hpp"
+#include "../utils/pool.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define HDA_BATCH 64            // children buffered per destination before a send
+#define HDA_CLOSED_SIZE 1000003 // initial closed list size of each thread
+
+// HDAstar is hash distributed A* (Kishimoto, Fukunaga and Botea, 2009).
+// Every state is owned by the thread its hash maps to, and only the
+// owner keeps it on an open or closed list, so neither list needs a
+// lock.  Children are sent to their owner in batches through a
+// lock-free inbox.
+template <class D> struct HDAstar : public SearchAlgorithm<D> {
+
+	typedef typename D::State State;
+	typedef typename D::PackedState PackedState;
+	typedef typename D::Cost Cost;
+	typedef typename D::Oper Oper;
+
+	struct Node {
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
+		int openind;
+		Node *parent;
+		Node *msgnxt;	// next node in a batch sent to the owner
+		unsigned long hash;
+		PackedState state;
+		Oper op, pop;
+		Cost f, g;
+
+		Node() : openind(-1) {
+		}
+
+		static ClosedEntry<Node, D> &closedentry(Node *n) {
+			return n->closedent;
+		}
+
+		static PackedState &key(Node *n) {
+			return n->state;
+		}
+
+		static void setind(Node *n, int i) {
+			n->openind = i;
+		}
+
+		static int getind(const Node *n) {
+			return n->openind;
+		}
+
+		static bool pred(Node *a, Node *b) {
+			if (a->f == b->f)
+				return a->g > b->g;
+			return a->f < b->f;
+		}
+
+		static Cost prio(Node *n) {
+			return n->f;
+		}
+
+		static Cost tieprio(Node *n) {
+			return n->g;
+		}
+	};
+
+	HDAstar(int argc, const char *argv[]) :
+		SearchAlgorithm<D>(argc, argv) {
+		num_threads = std::thread::hardware_concurrency();
+		for (int i = 0; i < argc; i++) {
+			if (strcmp(argv[i], "-threads") == 0)
+				num_threads = strtoul(argv[++i], NULL, 10);
+			else if (strcmp(argv[i], "-batch") == 0)
+				batch = strtoul(argv[++i], NULL, 10);
+		}
+		if (num_threads == 0)
+			num_threads = 1;
+		if (batch == 0)
+			batch = 1;
+	}
+
+	~HDAstar() {
+	}
+
+	void search(D &d, typename D::State &s0) {
+		this->start();
+
+		workers.clear();
+		for (size_t i = 0; i < num_threads; i++) {
+			workers.emplace_back(new Worker(num_threads));
+			workers.back()->closed.init(d);
+		}
+		incumbent = NULL;
+		bound.store(std::numeric_limits<double>::infinity());
+		done.store(false);
+		nexpd.store(0);
+		ngend.store(0);
+		// every thread starts out busy
+		work.store(num_threads);
+
+		Worker &w0 = *workers[owner(d, s0)];
+		Node *n0 = init(d, s0, w0.nodes);
+		w0.closed.add(n0, n0->hash);
+		w0.open.push(n0);
+
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < num_threads; i++)
+			threads.emplace_back(&HDAstar::threadloop, this, std::ref(d), i);
+		for (auto &t : threads)
+			t.join();
+
+		for (auto &w : workers) {
+			this->res.expd += w->expd;
+			this->res.gend += w->gend;
+			this->res.dups += w->dups;
+			this->res.reopnd += w->reopnd;
+		}
+		if (incumbent)
+			solpath<D, Node>(d, incumbent, this->res);
+		this->finish();
+	}
+
+	virtual void reset() {
+		SearchAlgorithm<D>::reset();
+		workers.clear();
+	}
+
+	virtual void output(FILE *out) {
+		SearchAlgorithm<D>::output(out);
+		dfpair(out, "open list type", "%s", workers[0]->open.kind());
+		dfpair(out, "node size", "%u", sizeof(Node));
+		dfpair(out, "threads", "%lu", num_threads);
+		dfpair(out, "batch size", "%lu", batch);
+
+		unsigned long sent = 0, sends = 0, minexpd = workers[0]->expd, maxexpd = 0;
+		for (auto &w : workers) {
+			sent += w->sent;
+			sends += w->sends;
+			minexpd = std::min(minexpd, w->expd);
+			maxexpd = std::max(maxexpd, w->expd);
+		}
+		dfpair(out, "nodes sent", "%lu", sent);
+		dfpair(out, "batches sent", "%lu", sends);
+		dfpair(out, "min thread expansions", "%lu", minexpd);
+		dfpair(out, "max thread expansions", "%lu", maxexpd);
+	}
+
+private:
+
+	// An Outbox is a chain of nodes waiting to go to one owner.
+	struct Outbox {
+		Node *head = NULL, *tail = NULL;
+		unsigned long n = 0;
+	};
+
+	struct alignas(64) Worker {
+		Worker(size_t nthreads) : inbox(NULL), closed(HDA_CLOSED_SIZE), out(nthreads) {
+		}
+
+		// senders link a batch onto inbox with one CAS and the owner
+		// takes everything at once, so the list never suffers ABA.
+		alignas(64) std::atomic<Node*> inbox;
+		alignas(64) OpenList<Node, Node, Cost> open;
+		ClosedList<Node, Node, D> closed;
+		Pool<Node> nodes;
+		std::vector<Outbox> out;
+		unsigned long expd = 0, gend = 0, dups = 0, reopnd = 0, sent = 0, sends = 0;
+		unsigned long gendpost = 0; // gend already added to ngend
+	};
+
+	void threadloop(D &d, size_t id) {
+		Worker &w = *workers[id];
+
+		while (!done.load(std::memory_order_relaxed)) {
+			receive(w);
+
+			// open is f ordered, once its front cannot beat the
+			// incumbent nothing on it can
+			Node *n = w.open.front();
+			if (n && (double) n->f >= bound.load(std::memory_order_relaxed))
+				n = NULL;
+			if (n)
+				w.open.pop();
+			if (!n) {
+				flush(w);
+				if (w.inbox.load(std::memory_order_relaxed) == NULL)
+					idle(w);
+				continue;
+			}
+
+			State buf, &state = d.unpack(buf, n->state);
+			if (d.isgoal(state)) {
+				std::lock_guard<std::mutex> lk(incumbent_mutex);
+				if (!incumbent || n->g < incumbent->g) {
+					incumbent = n;
+					bound.store((double) n->g, std::memory_order_relaxed);
+				}
+				continue;
+			}
+
+			expand(d, w, n, state);
+
+			if (w.expd % batch == 0) {
+				flush(w);
+				SearchStats s;
+				s.expd = nexpd.fetch_add(batch, std::memory_order_relaxed) + batch;
+				s.gend = ngend.fetch_add(w.gend - w.gendpost, std::memory_order_relaxed) + w.gend - w.gendpost;
+				w.gendpost = w.gend;
+				if (this->lim.reached(s))
+					done.store(true);
+			}
+		}
+	}
+
+	// idle waits for more nodes or for the search to end.  The work
+	// counter holds one for each busy thread and one for each node in
+	// flight, and only busy threads send, so once it reads zero no
+	// thread can ever be handed another node.
+	void idle(Worker &w) {
+		work.fetch_sub(1);
+		for ( ; ; ) {
+			if (done.load(std::memory_order_relaxed))
+				return;
+			if (w.inbox.load(std::memory_order_relaxed) != NULL) {
+				work.fetch_add(1);
+				return;
+			}
+			if (work.load() == 0) {
+				done.store(true);
+				return;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	void receive(Worker &w) {
+		Node *n = w.inbox.exchange(NULL, std::memory_order_acquire);
+		long k = 0;
+		while (n) {
+			Node *nxt = n->msgnxt;
+			consider(w, n);
+			n = nxt;
+			k++;
+		}
+		if (k > 0)
+			work.fetch_sub(k);
+	}
+
+	// send queues kid for the thread with the given id.
+	void send(Worker &w, size_t id, Node *kid) {
+		Outbox &o = w.out[id];
+		kid->msgnxt = NULL;
+		if (o.tail)
+			o.tail->msgnxt = kid;
+		else
+			o.head = kid;
+		o.tail = kid;
+		if (++o.n >= batch)
+			post(w, id);
+	}
+
+	void flush(Worker &w) {
+		for (size_t i = 0; i < w.out.size(); i++) {
+			if (w.out[i].n > 0)
+				post(w, i);
+		}
+	}
+
+	// post links the whole outbox onto the owner's inbox.
+	void post(Worker &w, size_t id) {
+		Outbox &o = w.out[id];
+		std::atomic<Node*> &inbox = workers[id]->inbox;
+		work.fetch_add(o.n);
+		Node *old = inbox.load(std::memory_order_relaxed);
+		do {
+			o.tail->msgnxt = old;
+		} while (!inbox.compare_exchange_weak(old, o.head, std::memory_order_release, std::memory_order_relaxed));
+		w.sent += o.n;
+		w.sends++;
+		o = Outbox();
+	}
+
+	void expand(D &d, Worker &w, Node *n, State &state) {
+		w.expd++;
+
+		typename D::Operators ops(d, state);
+		for (unsigned int i = 0; i < ops.size(); i++) {
+			if (ops[i] == n->pop)
+				continue;
+			w.gend++;
+
+			Node *kid = w.nodes.construct();
+			assert (kid);
+			typename D::Edge e(d, state, ops[i]);
+			kid->g = n->g + e.cost;
+			kid->f = kid->g + d.h(e.state);
+			if ((double) kid->f >= bound.load(std::memory_order_relaxed)) {
+				w.nodes.destruct(kid);
+				continue;
+			}
+			d.pack(kid->state, e.state);
+			kid->hash = kid->state.hash(&d);
+			kid->parent = n;
+			kid->op = ops[i];
+			kid->pop = e.revop;
+
+			size_t id = owner(kid->hash);
+			if (&w == workers[id].get())
+				consider(w, kid);
+			else
+				send(w, id, kid);
+		}
+	}
+
+	// consider adds a node to the open and closed lists of its owner,
+	// w.  Dropped nodes go to w's pool even if another thread made
+	// them, the pool only hands out memory.
+	void consider(Worker &w, Node *kid) {
+		if ((double) kid->f >= bound.load(std::memory_order_relaxed)) {
+			w.nodes.destruct(kid);
+			return;
+		}
+		Node *dup = w.closed.find(kid->state, kid->hash);
+		if (!dup) {
+			w.closed.add(kid, kid->hash);
+			w.open.push(kid);
+			return;
+		}
+		w.dups++;
+		if (kid->g >= dup->g) {
+			w.nodes.destruct(kid);
+			return;
+		}
+		bool isopen = w.open.mem(dup);
+		if (isopen)
+			w.open.pre_update(dup);
+		dup->f = kid->f;
+		dup->g = kid->g;
+		dup->parent = kid->parent;
+		dup->op = kid->op;
+		dup->pop = kid->pop;
+		if (isopen) {
+			w.open.post_update(dup);
+		} else {
+			w.reopnd++;
+			w.open.push(dup);
+		}
+		w.nodes.destruct(kid);
+	}
+
+	// owner maps a hash to a thread.  The hash is mixed first so the
+	// owner does not correlate with the closed list bin.
+	size_t owner(unsigned long h) {
+		return ((h * 0x9E3779B97F4A7C15ul) >> 32) % num_threads;
+	}
+
+	size_t owner(D &d, State &s) {
+		PackedState pkd;
+		d.pack(pkd, s);
+		return owner(pkd.hash(&d));
+	}
+
+	Node *init(D &d, State &s0, Pool<Node> &nodes) {
+		Node *n0 = nodes.construct();
+		d.pack(n0->state, s0);
+		n0->hash = n0->state.hash(&d);
+		n0->g = Cost(0);
+		n0->f = d.h(s0);
+		n0->pop = n0->op = D::Nop;
+		n0->parent = NULL;
+		return n0;
+	}
+
+	size_t num_threads = 1;
+	size_t batch = HDA_BATCH;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::mutex incumbent_mutex;
+	Node *incumbent = NULL;
+	std::atomic<double> bound; // cost of the incumbent, for pruning
+
+	std::atomic<bool> done;
+	std::atomic<long> work;
+	std::atomic<unsigned long> nexpd, ngend; // approximate, for the limit
+};
@@ -11,7 +11,7 @@ template <class D> struct Hhatgreedy : public SearchAlgorithm<D> {
 
 	struct Node {
     public:
-      ClosedEntry<Node, D> closedent;
+      [[no_unique_address]] ClosedEntry<Node, D> closedent;
       int openind;
       Node *parent;
       PackedState state;
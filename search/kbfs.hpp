@@ -6,6 +6,11 @@
 #include <stop_token> // for stopping the threads
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#define KBFS_SPIN_YIELD 1024 // spins between yields while a -lockfree thread waits
 
 enum ThreadState {to_expand, expanded};
 
@@ -78,6 +83,15 @@ template <class D> struct KBFS : public SearchAlgorithm<D> {
 			if (strcmp(argv[i], "-exp") == 0){
 				extra_calcs = strtod(argv[++i], NULL);
 			}
+			if (strcmp(argv[i], "-lockfree") == 0){
+				lockfree = true;
+			}
+			if (strcmp(argv[i], "-batch") == 0){
+				batch = strtoul(argv[++i], NULL, 10);
+				if(batch == 0){
+					exit(1);
+				}
+			}
 		}
 	}
 
@@ -90,18 +104,33 @@ template <class D> struct KBFS : public SearchAlgorithm<D> {
 			if(token.stop_requested()){
 				return;
 			}
-			children[i].clear();
-			// check topNodes[i] for the node* to expand
-			Node* n = node_to_expand[i];
-			assert(n);
-			State buf, &state = d.unpack(buf, n->state);
-			children[i] = expand(d, n, state, nodes);
+			expand_batch(d, slots[i], nodes);
 			thread_state[i] = ThreadState::expanded;
 			lk.unlock();
 			worker_done[i].notify_one();
 		}
 	}
 
+	// spin_worker is worker for -lockfree, it waits on its slot's
+	// posted round without taking a lock.
+	void spin_worker(D &d, size_t i, std::stop_token token, Pool<Node> * nodes){
+		Slot &slot = slots[i];
+		unsigned long seen = 0;
+		for (;;) {
+			double idle_start = walltime();
+			for (unsigned long spins = 1; slot.posted.load(std::memory_order_acquire) == seen; spins++) {
+				if (token.stop_requested())
+					return;
+				if (spins % KBFS_SPIN_YIELD == 0)
+					std::this_thread::yield();
+			}
+			slot.idle += walltime() - idle_start;
+			seen = slot.posted.load(std::memory_order_relaxed);
+			expand_batch(d, slot, nodes);
+			slot.done.store(seen, std::memory_order_release);
+		}
+	}
+
 	void search(D &d, typename D::State &s0) {
 		//kpbfs main thread
 		const std::size_t k = num_threads;
@@ -126,77 +155,59 @@ template <class D> struct KBFS : public SearchAlgorithm<D> {
 			
 			Pool<Node> * nodes = new Pool<Node>();
 			pools.push_back(nodes);
-			threads.emplace_back(&KBFS::worker, this, std::ref(d), i, st, nodes);
+			if (lockfree)
+				threads.emplace_back(&KBFS::spin_worker, this, std::ref(d), i, st, nodes);
+			else
+				threads.emplace_back(&KBFS::worker, this, std::ref(d), i, st, nodes);
 		}
 
 		std::cout << "Threads created" << std::endl;
 
+		std::vector<std::size_t> pending(k);
 		while (!open.empty() && !SearchAlgorithm<D>::limit() && !found) {
-			// get k top nodes on open list (less than k if open list is smaller)
+			// get k batches of top nodes on open list (less if open list is smaller)
+			rounds++;
 			std::size_t n_threads_dispatched = 0;
 			for (std::size_t i = 0; i < k; i++) {
 				if (open.empty()) {
 					break;
 				}
-				std::unique_lock<std::mutex> lk(locks[i]);
-				node_to_expand[i] = open.pop();
-				thread_state[i] = ThreadState::to_expand;
-				lk.unlock();
-				worker_start[i].notify_one();
-				n_threads_dispatched++;
+				std::unique_lock<std::mutex> lk(locks[i], std::defer_lock);
+				if (!lockfree)
+					lk.lock();
+				slots[i].batch.clear();
+				while (slots[i].batch.size() < batch && !open.empty())
+					slots[i].batch.push_back(open.pop());
+				if (lockfree) {
+					slots[i].posted.store(rounds, std::memory_order_release);
+				} else {
+					thread_state[i] = ThreadState::to_expand;
+					lk.unlock();
+					worker_start[i].notify_one();
+				}
+				pending[n_threads_dispatched++] = i;
 			}
 
-			// add all to open
-			for (size_t i = 0; i < n_threads_dispatched; i++) {
-				std::unique_lock<std::mutex> lk(locks[i]);
-				worker_done[i].wait(lk, [&]{return thread_state[i] == ThreadState::expanded;});
-
-				std::vector<Node*>& exp_nodes = children[i];
-				SearchAlgorithm<D>::res.expd++;
-				for (Node* kid : exp_nodes){
-					State buf, &state = d.unpack(buf, kid->state);
-					if (d.isgoal(state)) {
-						solpath<D, Node>(d, kid, this->res);
-						// start barrier to stop the threads
-						found = true;
-						break;
-					}
-					SearchAlgorithm<D>::res.gend++;
-
-					auto dup_it = closed.find(kid->state);
-					if (dup_it != closed.end()) { // if its in closed, check if dup is better
-						Node *dup = dup_it->second;
-						this->res.dups++;
-						if (kid->g >= dup->g) { // kid is worse so don't bother
-							pools[i]->destruct(kid);
-							continue;
-						}
-						// Else, update existing duplicate with better path
-						bool isopen = open.mem(dup);
-						if (isopen)
-							open.pre_update(dup);
-						dup->f = dup->f - dup->g + kid->g;
-						dup->g = kid->g;
-						dup->parent = kid;
-						dup->op = kid->op;
-						dup->pop = kid->pop;
-						if (isopen) {
-							open.post_update(dup);
-						} else {
-							this->res.reopnd++;
-							open.push(dup);
-						}
-						pools[i]->destruct(kid);
+			// add all to open, in the order the threads finish with -lockfree
+			std::size_t n_pending = n_threads_dispatched;
+			for (unsigned long spins = 1; n_pending > 0 && !found; spins++) {
+				std::size_t j = 0;
+				if (lockfree) {
+					while (j < n_pending && slots[pending[j]].done.load(std::memory_order_acquire) != rounds)
+						j++;
+					if (j == n_pending) {
+						if (spins % KBFS_SPIN_YIELD == 0)
+							std::this_thread::yield();
 						continue;
 					}
-
-					// add to closed and open
-					closed.emplace(kid->state, kid);
-					open.push(kid);
+				} else {
+					std::unique_lock<std::mutex> lk(locks[pending[j]]);
+					worker_done[pending[j]].wait(lk, [&]{return thread_state[pending[j]] == ThreadState::expanded;});
 				}
-				if(found) break;
+				std::size_t i = pending[j];
+				pending[j] = pending[--n_pending];
+				found = add_children(d, slots[i], pools[i]);
 			}
-			if(found) break;
 		}
 		stop_source.request_stop();
 		for (std::size_t i = 0; i < k; i++){
@@ -223,13 +234,95 @@ template <class D> struct KBFS : public SearchAlgorithm<D> {
 		// dfpair(stdout, "open list type", "%s", open.kind());
 		dfpair(stdout, "open list type", "%s", "boost::unordered_flat_map");
 		dfpair(stdout, "node size", "%u", sizeof(Node));
+		dfpair(stdout, "dispatch", "%s", lockfree ? "lockfree" : "condition variables");
+		dfpair(stdout, "batch size", "%lu", batch);
+		dfpair(stdout, "rounds", "%lu", rounds);
+		double wall = this->res.wallend - this->res.wallstart;
+		if (wall > 0)
+			dfpair(stdout, "rounds per second", "%g", rounds / wall);
+		if (lockfree) {
+			for (std::size_t i = 0; i < num_threads; i++) {
+				std::string key = "worker " + std::to_string(i) + " idle time";
+				dfpair(stdout, key.c_str(), "%g", slots[i].idle);
+			}
+		}
 	}
 
 private:
 
-	std::vector<Node*> expand(D &d, Node *n, State &state, Pool<Node> *nodes) {
-		std::vector<Node*> children;
+	// A Slot is a thread's share of a round: the nodes it expands and
+	// the children it generated, both reused from round to round.  With -lockfree the main thread posts
+	// a round number once batch is filled and the thread sets done to
+	// it once kids is ready.
+	struct alignas(64) Slot {
+		std::atomic<unsigned long> posted{0};
+		std::atomic<unsigned long> done{0};
+		std::vector<Node*> batch;
+		std::vector<Node*> kids;
+		double idle = 0; // seconds spent waiting for a batch, -lockfree only
+	};
+
+	void expand_batch(D &d, Slot &slot, Pool<Node> *nodes) {
+		slot.kids.clear();
+		for (Node *n : slot.batch) {
+			assert(n);
+			State buf, &state = d.unpack(buf, n->state);
+			expand(d, n, state, nodes, slot.kids);
+		}
+	}
+
+	// add_children merges a finished slot into open and closed,
+	// returning true if a goal was generated.
+	bool add_children(D &d, Slot &slot, Pool<Node> *pool) {
+		SearchAlgorithm<D>::res.expd += slot.batch.size();
+		for (Node* kid : slot.kids){
+			State buf, &state = d.unpack(buf, kid->state);
+			if (d.isgoal(state)) {
+				solpath<D, Node>(d, kid, this->res);
+				// start barrier to stop the threads
+				return true;
+			}
+			SearchAlgorithm<D>::res.gend++;
+
+			auto dup_it = closed.find(kid->state);
+			if (dup_it != closed.end()) { // if its in closed, check if dup is better
+				Node *dup = dup_it->second;
+				this->res.dups++;
+				if (kid->g >= dup->g) { // kid is worse so don't bother
+					pool->destruct(kid);
+					continue;
+				}
+				// Else, update existing duplicate with better path
+				bool isopen = open.mem(dup);
+				if (isopen)
+					open.pre_update(dup);
+				dup->f = dup->f - dup->g + kid->g;
+				dup->g = kid->g;
+				dup->parent = kid->parent;
+				dup->op = kid->op;
+				dup->pop = kid->pop;
+				if (isopen) {
+					open.post_update(dup);
+				} else {
+					this->res.reopnd++;
+					open.push(dup);
+				}
+				pool->destruct(kid);
+				continue;
+			}
 
+			// add to closed and open
+			closed.emplace(kid->state, kid);
+			open.push(kid);
+		}
+		return false;
+	}
+
+	// expand appends n's children to the caller's buffer.  The buffers
+	// live in the Slots and are only cleared between rounds, so once
+	// they have grown to fit a batch expanding allocates nothing but
+	// the kids, which come from the thread's Pool.
+	void expand(D &d, Node *n, State &state, Pool<Node> *nodes, std::vector<Node*> &children) {
 		typename D::Operators ops(d, state);
 		for (unsigned int i = 0; i < ops.size(); i++) {
 			if (ops[i] == n->pop)
@@ -254,8 +347,6 @@ private:
 			sum = sin(sum + rand());
 		}
 		total_sum += sum;
-
-		return children;
 	}
 
 	Node *init(D &d, State &s0, Pool<Node> *nodes) {
@@ -272,8 +363,8 @@ private:
 		worker_start = std::vector<std::condition_variable>(num_threads);
 		worker_done = std::vector<std::condition_variable>(num_threads);
 		locks = std::vector<std::mutex>(num_threads);
-		node_to_expand = std::vector<Node *>(num_threads, nullptr);
-		children = std::vector<std::vector<Node *>>(num_threads);
+		slots.reset(new Slot[num_threads]);
+		rounds = 0;
 		thread_state = std::vector<ThreadState>(num_threads, ThreadState::expanded);
 	}
 
@@ -284,8 +375,10 @@ private:
 	boost::unordered_flat_map<PackedState, Node*, StateHasher, StateEq> closed;
 	
 	std::size_t num_threads;
-	std::vector<Node *> node_to_expand;
-	std::vector<std::vector<Node *>> children;
+	bool lockfree = false; // -lockfree hands out work through slots instead of locks
+	std::size_t batch = 1; // -batch m nodes per thread per round
+	unsigned long rounds = 0;
+	std::unique_ptr<Slot[]> slots;
 	std::vector<ThreadState> thread_state;
 
 	std::vector<std::condition_variable> worker_start;
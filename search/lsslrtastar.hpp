@@ -80,7 +80,7 @@ private:
 		Node() : dead(false), expd(false) {
 		}
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 	};
 
 	class Nodes {
@@ -173,7 +173,7 @@ private:
 		bool closed;
 
 	private:
-		ClosedEntry<LssNode, D> nodesent;
+		[[no_unique_address]] ClosedEntry<LssNode, D> nodesent;
 	};
 
 public:
@@ -1,6 +1,7 @@
 // Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
 #include "search.hpp"
 #include "idastar.hpp"
+#include "pidastar.hpp"
 #include "dfsstar.hpp"
 #include "dfsstar-co.hpp"
 #include "ildsstar.hpp"
@@ -29,9 +30,22 @@
 #include "astar-basic.hpp"
 #include "kbfs.hpp"
 #include "spastar.hpp"
+#include "hdastar.hpp"
+#include "pbnf.hpp"
+#include "portfolio.hpp"
 
+#include "../utils/utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 // Functions for conveniently defining a new main
 // function for a domain.
@@ -83,12 +97,100 @@ template<class D> Result<D> searchGet(SearchAlgorithm<D>*(*get)(int, const char
 	return res;
 }
 
+// batchinsts returns the instances for a batch: the files in a
+// directory, sorted by name, or the non-empty lines of a list file.
+static inline std::vector<std::string> batchinsts(const char *path) {
+	std::vector<std::string> insts;
+	if (isdir(path)) {
+		for (auto &ent : readdir(path)) {
+			if (!isdir(ent))
+				insts.push_back(ent);
+		}
+		std::sort(insts.begin(), insts.end());
+		return insts;
+	}
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+		fatalx(errno, "Failed to open %s for reading", path);
+	for (boost::optional<std::string> l = readline(f); l; l = readline(f)) {
+		if (l->size() > 0)
+			insts.push_back(*l);
+	}
+	fclose(f);
+	return insts;
+}
+
+// searchBatch solves each instance of a batch given with -insts, a
+// directory or a file listing instance paths, on a pool of -jobs
+// threads (all cores by default) in a single process.  mkdom makes
+// the domain for an instance from its file, writing any domain pairs.
+// The datafile for each instance is buffered and written whole when
+// it finishes, so the blocks on standard output are in the order they
+// finish.
+template<class D> void searchBatch(const char *batch, D *(*mkdom)(FILE*, int, const char*[]),
+		SearchAlgorithm<D>*(*get)(int, const char *[]), int argc, const char *argv[]) {
+	unsigned int jobs = std::thread::hardware_concurrency();
+	for (int i = 0; i < argc; i++) {
+		if (i < argc - 1 && strcmp(argv[i], "-jobs") == 0)
+			jobs = strtoul(argv[++i], NULL, 10);
+		// the timer behind these limits is per process
+		if (strcmp(argv[i], "-walltime") == 0 || strcmp(argv[i], "-cputime") == 0)
+			fatal("Time limits are not supported with -insts");
+	}
+	if (jobs == 0)
+		jobs = 1;
+
+	std::vector<std::string> insts = batchinsts(batch);
+	std::atomic<size_t> next(0);
+	std::mutex outmtx;
+
+	auto worker = [&]() {
+		for (size_t i = next++; i < insts.size(); i = next++) {
+			char *buf = NULL;
+			size_t sz = 0;
+			FILE *out = open_memstream(&buf, &sz);
+			if (!out)
+				fatalx(errno, "Failed to buffer the output");
+			dfredirect(out);
+
+			dfheader(stdout);
+			FILE *lvl = fopen(insts[i].c_str(), "r");
+			if (!lvl)
+				fatalx(errno, "Failed to open %s for reading", insts[i].c_str());
+			D *d = mkdom(lvl, argc, argv);
+			fclose(lvl);
+			dfpair(stdout, "level", "%s", insts[i].c_str());
+			searchGet<D>(get, *d, argc, argv);
+			delete d;
+			dffooter(stdout);
+
+			dfredirect(NULL);
+			fclose(out);
+			{
+				std::lock_guard<std::mutex> lk(outmtx);
+				fwrite(buf, 1, sz, stdout);
+				fflush(stdout);
+			}
+			free(buf);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < jobs; i++)
+		threads.emplace_back(worker);
+	for (auto &t : threads)
+		t.join();
+}
+
 template<class D> SearchAlgorithm<D> *getsearch(int argc, const char *argv[]) {
 	if (argc < 2)
 		fatal("No algorithm specified");
 
 	if (strcmp(argv[1], "idastar") == 0)
 		return new Idastar<D>(argc, argv);
+	if (strcmp(argv[1], "pidastar") == 0)
+		return new PIdastar<D>(argc, argv);
 	if (strcmp(argv[1], "dfsstar") == 0)
 		return new DFSstar<D>(argc, argv);
 	if (strcmp(argv[1], "dfsstar-co") == 0)
@@ -151,6 +253,12 @@ template<class D> SearchAlgorithm<D> *getsearch(int argc, const char *argv[]) {
 		return new KBFS<D>(argc, argv);
 	else if (strcmp(argv[1], "spastar") == 0)
 		return new SPAstar<D>(argc, argv);
+	else if (strcmp(argv[1], "hdastar") == 0)
+		return new HDAstar<D>(argc, argv);
+	else if (strcmp(argv[1], "pbnf") == 0)
+		return new PBNF<D>(argc, argv);
+	else if (strcmp(argv[1], "portfolio") == 0)
+		return new Portfolio<D>(argc, argv);
 
 	fatal("Unknown algorithm: %s", argv[1]);
 	return NULL;	// Unreachable
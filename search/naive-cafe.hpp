@@ -5,9 +5,16 @@
 #pragma once
 #include "../search/search.hpp"
 #include "../utils/pool.hpp"
+#include "../structs/mpmcqueue.hpp"
 #include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stop_token>
 #include <thread>
 
+#define NAIVE_CAFE_QUEUE_SIZE 4096 // children waiting for a worker, the main thread expands any past this
+#define NAIVE_CAFE_SPIN_ROUNDS 16 // empty pops, each followed by a yield, before an idle worker parks
+
 template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a template? (https://www.geeksforgeeks.org/templates-cpp/)
 
 	typedef typename D::State State;
@@ -16,7 +23,7 @@ template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a
 	typedef typename D::Oper Oper;
 	
 	struct Node {
-		ClosedEntry<Node, D> closedent; // what is a closed entry?
+		[[no_unique_address]] ClosedEntry<Node, D> closedent; // what is a closed entry?
 		int openind; // Open Index
 		Node *parent; // Parent Node
 		std::atomic<int> isWorking; // 0 if not touched, 1 if being expanded, 2 if expanded
@@ -59,8 +66,17 @@ template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a
 	};
 
 	Naive_CAFE(int argc, const char *argv[]) :
-		SearchAlgorithm<D>(argc, argv), closed(30000001) {
+		SearchAlgorithm<D>(argc, argv), closed(30000001), tasks(NAIVE_CAFE_QUEUE_SIZE) {
+		num_threads = 1;
+		for (int i = 0; i < argc; i++) {
+			if (strcmp(argv[i], "-threads") == 0)
+				num_threads = strtoul(argv[++i], NULL, 10);
+		}
+		if (num_threads == 0)
+			fatal("-threads must be at least 1");
 		nodes = new Pool<Node>();
+		for (size_t i = 1; i < num_threads; i++)
+			worker_nodes.emplace_back(new Pool<Node>());
 	}
 
 	~Naive_CAFE() {
@@ -75,6 +91,19 @@ template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a
 		closed.add(n0);
 		open.push(n0);
 
+		// A fixed set of workers expands the children handed to them
+		// through the task queue.  They stop and are joined when
+		// the search returns.
+		std::vector<std::jthread> workers;
+		std::stop_source stop_source;
+		StopOnExit stop_workers{stop_source, pushed};
+		for (size_t i = 1; i < num_threads; i++) {
+			Pool<Node> &pool = *worker_nodes[i-1];
+			workers.emplace_back([this, &d, &pool, tok = stop_source.get_token()]() {
+				work(d, tok, pool);
+			});
+		}
+
 		while (!open.empty() && !SearchAlgorithm<D>::limit()) {
 			Node *n = open.pop();
 			State buf, &state = d.unpack(buf, n->state);
@@ -83,26 +112,34 @@ template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a
 				solpath<D, Node>(d, n, this->res);
 				break;
 			}
-			if(n->isWorking == 0){ // If not expanded, expand in the main thread
-				n->isWorking = 1;
-				expand(d, n, state);
+			SearchAlgorithm<D>::res.expd++;
+			int untouched = 0;
+			if(n->isWorking.compare_exchange_strong(untouched, 1)){ // If no worker took it, expand in the main thread
+				main_expd++;
+				expand(d, n, state, *nodes);
 			}
-			while(n->isWorking == 1){
-				// busy wait as the node is currently being expanded by a child
+			while(n->isWorking.load() == 1){
+				// busy wait as the node is currently being expanded by a worker
 			}
-			// for each child node, spawn a thread to expand it
+			// queue each new child for a worker to expand
+			bool queued = false;
 			for(size_t i = 0; i < n->children.size(); i++){
 				Node *child = n->children[i];
-				child->isWorking = 1;
+				SearchAlgorithm<D>::res.gend++;
 				// if the child is not in the closed list, add it to the closed list and the open list
 				unsigned long hash = child->state.hash(&d);
-				if(!closed.find(child->state, hash)){
-					closed.add(child);
-					open.push(child);
-				} // Duplicates should not appear so if they are in the closed list, they should not be re-expanded
-				// start and detach a thread to expand the child node
-				std::thread t(&Naive_CAFE::expand, this, std::ref(d), child, std::ref(d.unpack(buf, child->state)));
-				t.detach();
+				if(closed.find(child->state, hash))
+					continue; // Duplicates should not appear so if they are in the closed list, they should not be re-expanded
+				closed.add(child);
+				open.push(child);
+				if(num_threads > 1 && !tasks.push(child))
+					dropped++; // queue is full, the main thread will expand it when it is popped
+				else
+					queued = true;
+			}
+			if(queued){ // wake the parked workers
+				pushed.fetch_add(1);
+				pushed.notify_all();
 			}
 		}
 		this->finish();
@@ -114,6 +151,15 @@ template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a
 		closed.clear();
 		delete nodes;
 		nodes = new Pool<Node>();
+		for (auto &pool : worker_nodes)
+			pool.reset(new Pool<Node>());
+		main_expd = 0;
+		worker_expd = 0;
+		dropped = 0;
+		// children queued when the goal was found point into the old pools
+		Node *n;
+		while (tasks.pop(n))
+			;
 	}
 
 	virtual void output(FILE *out) {
@@ -121,22 +167,71 @@ template <class D> struct Naive_CAFE : public SearchAlgorithm<D> { // what is a
 		closed.prstats(stdout, "closed ");
 		dfpair(stdout, "open list type", "%s", open.kind());
 		dfpair(stdout, "node size", "%u", sizeof(Node));
+		dfpair(stdout, "threads", "%lu", num_threads);
+		dfpair(stdout, "main thread expansions", "%lu", main_expd);
+		dfpair(stdout, "worker expansions", "%lu", worker_expd.load());
+		dfpair(stdout, "children left to the main thread", "%lu", dropped);
+		double wall = this->res.wallend - this->res.wallstart;
+		if (wall > 0) {
+			dfpair(stdout, "expansion rate", "%g", this->res.expd / wall);
+			dfpair(stdout, "total expansion rate", "%g", (main_expd + worker_expd.load()) / wall);
+		}
 	}
 
 private:
-	void expand(D &d, Node *n, State &state) { // counts generated and expanded nodes and calls considerkid on each possible option for a child
-		SearchAlgorithm<D>::res.expd++;
+	// StopOnExit stops the workers however search returns, before
+	// their jthreads are joined, and wakes any that are parked.
+	struct StopOnExit {
+		std::stop_source &src;
+		std::atomic<std::uint32_t> &pushed;
+		~StopOnExit() {
+			src.request_stop();
+			pushed.fetch_add(1);
+			pushed.notify_all();
+		}
+	};
+
+	// work expands children from the task queue until the search stops.
+	// A child the main thread already started on is skipped.  With the
+	// queue empty for a while, a worker parks until the main thread
+	// queues more.
+	void work(D &d, std::stop_token tok, Pool<Node> &pool) {
+		Node *n;
+		unsigned int misses = 0;
+		while (!tok.stop_requested()) {
+			std::uint32_t seen = pushed.load();
+			if (!tasks.pop(n)) {
+				if (++misses < NAIVE_CAFE_SPIN_ROUNDS) {
+					std::this_thread::yield();
+					continue;
+				}
+				// the stop is requested before the last bump, so
+				// either it is seen here or the wait returns
+				if (!tok.stop_requested())
+					pushed.wait(seen);
+				misses = 0;
+				continue;
+			}
+			misses = 0;
+			int untouched = 0;
+			if (!n->isWorking.compare_exchange_strong(untouched, 1))
+				continue;
+			State buf, &state = d.unpack(buf, n->state);
+			expand(d, n, state, pool);
+			worker_expd++;
+		}
+	}
 
+	void expand(D &d, Node *n, State &state, Pool<Node> &pool) { // calls considerkid on each possible option for a child, kids come from the caller's pool
 		typename D::Operators ops(d, state);
 		for (unsigned int i = 0; i < ops.size(); i++) {
 			if (ops[i] == n->pop) 
 				continue;
-			SearchAlgorithm<D>::res.gend++;
 
 			Node *parent = n;
 			Oper op = ops[i];
 
-			Node *kid = nodes->construct(); // gets child node of operation
+			Node *kid = pool.construct(); // gets child node of operation
 			assert (kid);
 			typename D::Edge e(d, state, op);
 			kid->g = parent->g + e.cost;
@@ -164,4 +259,11 @@ private:
 	OpenList<Node, Node, Cost> open;
  	ClosedList<Node, Node, D> closed;
 	Pool<Node> *nodes;
+	std::vector<std::unique_ptr<Pool<Node>>> worker_nodes; // one per worker, Pool is not thread safe
+	MpmcQueue<Node*> tasks;
+	size_t num_threads; // including the main thread
+	size_t main_expd = 0;
+	std::atomic<size_t> worker_expd = 0;
+	size_t dropped = 0;
+	std::atomic<std::uint32_t> pushed = 0; // bumped when children are queued, workers park on it
 };
@@ -0,0 +1,359 @@
+// Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+#pragma once
+#include "../search/search.hpp"
+#include "../utils/pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define PBNF_MIN_EXPANSIONS 32 // expansions before a thread reconsiders its nblock
+#define PBNF_CLOSED_SIZE 1021  // initial closed list size of each nblock, prime as some hashes are the packed state
+
+// An AbstractDomain maps each state onto one of nblocks() abstract
+// states and lists the abstract states that are one step away from
+// each of them.  See search/domain_template.
+template <class D> concept AbstractDomain = requires(const D &d, typename D::State &s, std::vector<unsigned int> &bs) {
+	{ d.nblocks() } -> std::convertible_to<unsigned int>;
+	{ d.abstract(s) } -> std::convertible_to<unsigned int>;
+	d.abstractsuccs(0u, bs);
+};
+
+// PBNF is parallel best nblock first (Burns, Lemons, Ruml and Zhou,
+// 2010).  The states of each abstract state, an nblock, have their own
+// open and closed lists.  A thread that holds an nblock also owns the
+// lists of its abstract successors, so all duplicate detection is done
+// without locks and only the choice of nblock is serialized.
+template <class D> struct PBNF : public SearchAlgorithm<D> {
+
+	typedef typename D::State State;
+	typedef typename D::PackedState PackedState;
+	typedef typename D::Cost Cost;
+	typedef typename D::Oper Oper;
+
+	struct Node {
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
+		int openind;
+		Node *parent;
+		PackedState state;
+		Oper op, pop;
+		Cost f, g;
+
+		Node() : openind(-1) {
+		}
+
+		static ClosedEntry<Node, D> &closedentry(Node *n) {
+			return n->closedent;
+		}
+
+		static PackedState &key(Node *n) {
+			return n->state;
+		}
+
+		static void setind(Node *n, int i) {
+			n->openind = i;
+		}
+
+		static int getind(const Node *n) {
+			return n->openind;
+		}
+
+		static bool pred(Node *a, Node *b) {
+			if (a->f == b->f)
+				return a->g > b->g;
+			return a->f < b->f;
+		}
+
+		static Cost prio(Node *n) {
+			return n->f;
+		}
+
+		static Cost tieprio(Node *n) {
+			return n->g;
+		}
+	};
+
+	PBNF(int argc, const char *argv[]) :
+		SearchAlgorithm<D>(argc, argv) {
+		if constexpr (!AbstractDomain<D>)
+			fatal("pbnf: the domain does not define an abstraction");
+		num_threads = std::thread::hardware_concurrency();
+		for (int i = 0; i < argc; i++) {
+			if (strcmp(argv[i], "-threads") == 0)
+				num_threads = strtoul(argv[++i], NULL, 10);
+			else if (strcmp(argv[i], "-minexp") == 0)
+				minexp = strtoul(argv[++i], NULL, 10);
+		}
+		if (num_threads == 0)
+			num_threads = 1;
+		if (minexp == 0)
+			minexp = 1;
+	}
+
+	~PBNF() {
+	}
+
+	void search(D &d, typename D::State &s0) {
+		this->start();
+		if constexpr (AbstractDomain<D>) {
+			initblocks(d);
+			incumbent = NULL;
+			bound.store(std::numeric_limits<double>::infinity());
+			done = false;
+			nacquired = 0;
+			switches = 0;
+
+			pools.clear();
+			for (size_t i = 0; i < num_threads; i++)
+				pools.emplace_back(new Pool<Node>());
+
+			Node *n0 = init(d, s0, *pools[0]);
+			Nblock &b0 = blocks[d.abstract(s0)];
+			b0.closed.add(n0);
+			b0.open.push(n0);
+
+			std::vector<std::thread> threads;
+			for (size_t i = 0; i < num_threads; i++)
+				threads.emplace_back(&PBNF::threadloop, this, std::ref(d), i);
+			for (auto &t : threads)
+				t.join();
+
+			if (incumbent)
+				solpath<D, Node>(d, incumbent, this->res);
+		}
+		this->finish();
+	}
+
+	virtual void reset() {
+		SearchAlgorithm<D>::reset();
+		blocks.reset();
+		pools.clear();
+	}
+
+	virtual void output(FILE *out) {
+		SearchAlgorithm<D>::output(out);
+		dfpair(out, "open list type", "%s", OpenList<Node, Node, Cost>().kind());
+		dfpair(out, "node size", "%u", sizeof(Node));
+		dfpair(out, "threads", "%lu", num_threads);
+		dfpair(out, "nblocks", "%u", nblocks);
+		dfpair(out, "min expansions", "%lu", minexp);
+		dfpair(out, "nblock acquisitions", "%lu", switches);
+	}
+
+private:
+
+	struct Nblock {
+		Nblock() : closed(PBNF_CLOSED_SIZE) {
+		}
+
+		OpenList<Node, Node, Cost> open;
+		ClosedList<Node, Node, D> closed;
+		std::vector<unsigned int> scope;     // this nblock and its successors
+		std::vector<unsigned int> interfere; // nblocks whose scope meets this one's
+		unsigned int sigma = 0;              // acquired nblocks in interfere
+	};
+
+	void initblocks(D &d) {
+		if constexpr (AbstractDomain<D>) {
+			nblocks = d.nblocks();
+			blocks.reset(new Nblock[nblocks]);
+
+			// inscope[x] lists the nblocks whose scope holds x
+			std::vector<std::vector<unsigned int>> inscope(nblocks);
+			for (unsigned int b = 0; b < nblocks; b++) {
+				Nblock &blk = blocks[b];
+				blk.closed.init(d);
+				blk.scope.push_back(b);
+				d.abstractsuccs(b, blk.scope);
+				std::sort(blk.scope.begin(), blk.scope.end());
+				blk.scope.erase(std::unique(blk.scope.begin(), blk.scope.end()), blk.scope.end());
+				for (unsigned int x : blk.scope)
+					inscope[x].push_back(b);
+			}
+			for (unsigned int b = 0; b < nblocks; b++) {
+				Nblock &blk = blocks[b];
+				for (unsigned int x : blk.scope)
+					blk.interfere.insert(blk.interfere.end(), inscope[x].begin(), inscope[x].end());
+				std::sort(blk.interfere.begin(), blk.interfere.end());
+				blk.interfere.erase(std::unique(blk.interfere.begin(), blk.interfere.end()), blk.interfere.end());
+			}
+		}
+	}
+
+	void threadloop(D &d, size_t id) {
+		Pool<Node> &nodes = *pools[id];
+		SearchStats stats;
+		stats.expd = stats.gend = stats.dups = stats.reopnd = 0;
+		Nblock *b = NULL;
+
+		while ((b = nextblock(b, stats)) != NULL) {
+			Cost f0 = b->open.front()->f;
+			for (unsigned long i = 0; i < minexp; ) {
+				// open is f ordered, once its front cannot beat the
+				// incumbent nothing on it can.  Nodes worse than the
+				// one the nblock was chosen for wait for another pick,
+				// so that a free nblock with better nodes goes first.
+				Node *n = b->open.front();
+				if (!n || n->f > f0 || (double) n->f >= bound.load(std::memory_order_relaxed))
+					break;
+				b->open.pop();
+
+				State buf, &state = d.unpack(buf, n->state);
+				if (d.isgoal(state)) {
+					std::lock_guard<std::mutex> lk(incumbent_mutex);
+					if (!incumbent || n->g < incumbent->g) {
+						incumbent = n;
+						bound.store((double) n->g, std::memory_order_relaxed);
+					}
+					continue;
+				}
+
+				expand(d, n, state, nodes, stats);
+				i++;
+			}
+		}
+	}
+
+	// nextblock releases b, if any, adds the thread's statistics to
+	// the result and returns the free nblock with the best node.  It
+	// waits while no nblock is free, and returns NULL once the search
+	// is over: no nblock is held and none has a node better than the
+	// incumbent.
+	Nblock *nextblock(Nblock *b, SearchStats &stats) {
+		std::unique_lock<std::mutex> lk(mutex);
+		this->res.expd += stats.expd;
+		this->res.gend += stats.gend;
+		this->res.dups += stats.dups;
+		this->res.reopnd += stats.reopnd;
+		stats.expd = stats.gend = stats.dups = stats.reopnd = 0;
+
+		if (b) {
+			for (unsigned int x : b->interfere)
+				blocks[x].sigma--;
+			nacquired--;
+			cv.notify_all();
+		}
+		if (this->limit())
+			done = true;
+
+		for ( ; ; ) {
+			if (done)
+				return NULL;
+
+			double bnd = bound.load(std::memory_order_relaxed);
+			Nblock *best = NULL;
+			Node *bestn = NULL;
+			for (unsigned int i = 0; i < nblocks; i++) {
+				Nblock &blk = blocks[i];
+				if (blk.sigma > 0 || blk.open.empty())
+					continue;
+				Node *n = blk.open.front();
+				if ((double) n->f < bnd && (!bestn || Node::pred(n, bestn))) {
+					bestn = n;
+					best = &blk;
+				}
+			}
+			if (best) {
+				for (unsigned int x : best->interfere)
+					blocks[x].sigma++;
+				nacquired++;
+				switches++;
+				return best;
+			}
+			if (nacquired == 0) {
+				done = true;
+				cv.notify_all();
+				return NULL;
+			}
+			cv.wait(lk);
+		}
+	}
+
+	// expand adds the children of n to the nblocks of their abstract
+	// states, which are all in the scope held by this thread.
+	void expand(D &d, Node *n, State &state, Pool<Node> &nodes, SearchStats &stats) {
+		if constexpr (AbstractDomain<D>) {
+			stats.expd++;
+
+			typename D::Operators ops(d, state);
+			for (unsigned int i = 0; i < ops.size(); i++) {
+				if (ops[i] == n->pop)
+					continue;
+				stats.gend++;
+
+				Node *kid = nodes.construct();
+				assert (kid);
+				typename D::Edge e(d, state, ops[i]);
+				kid->g = n->g + e.cost;
+				d.pack(kid->state, e.state);
+
+				Nblock &blk = blocks[d.abstract(e.state)];
+				unsigned long hash = kid->state.hash(&d);
+				Node *dup = blk.closed.find(kid->state, hash);
+				if (dup) {
+					stats.dups++;
+					if (kid->g >= dup->g) {
+						nodes.destruct(kid);
+						continue;
+					}
+					bool isopen = blk.open.mem(dup);
+					if (isopen)
+						blk.open.pre_update(dup);
+					dup->f = dup->f - dup->g + kid->g;
+					dup->g = kid->g;
+					dup->parent = n;
+					dup->op = ops[i];
+					dup->pop = e.revop;
+					if (isopen) {
+						blk.open.post_update(dup);
+					} else {
+						stats.reopnd++;
+						blk.open.push(dup);
+					}
+					nodes.destruct(kid);
+				} else {
+					kid->f = kid->g + d.h(e.state);
+					kid->parent = n;
+					kid->op = ops[i];
+					kid->pop = e.revop;
+					blk.closed.add(kid, hash);
+					blk.open.push(kid);
+				}
+			}
+		}
+	}
+
+	Node *init(D &d, State &s0, Pool<Node> &nodes) {
+		Node *n0 = nodes.construct();
+		d.pack(n0->state, s0);
+		n0->g = Cost(0);
+		n0->f = d.h(s0);
+		n0->pop = n0->op = D::Nop;
+		n0->parent = NULL;
+		return n0;
+	}
+
+	size_t num_threads = 1;
+	unsigned long minexp = PBNF_MIN_EXPANSIONS;
+
+	unsigned int nblocks = 0;
+	std::unique_ptr<Nblock[]> blocks;
+	std::vector<std::unique_ptr<Pool<Node>>> pools;
+
+	// guarded by mutex
+	std::mutex mutex;
+	std::condition_variable cv;
+	unsigned int nacquired = 0;
+	unsigned long switches = 0;
+	bool done = false;
+
+	std::mutex incumbent_mutex;
+	Node *incumbent = NULL;
+	std::atomic<double> bound; // cost of the incumbent, for pruning
+};
@@ -0,0 +1,297 @@
+// Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../search/search.hpp"
+
+void dfrowhdr(FILE*, const char*, unsigned int, ...);
+void dfrow(FILE*, const char*, const char*, ...);
+
+#define PIDA_TASKS 64        // subtrees per thread made at the top of each iteration
+#define PIDA_LIMIT_CHECK 1024 // expansions between checks of the search limits
+
+// PIdastar is a parallel IDA*.  Each iteration splits the top of the
+// tree breadth first into subtrees, deals them out to per-thread
+// deques and runs a depth first search on each subtree.  A thread with
+// an empty deque steals from the back of the others.
+template <class D> class PIdastar : public SearchAlgorithm<D> {
+
+public:
+
+	typedef typename D::State State;
+	typedef typename D::Cost Cost;
+	typedef typename D::Oper Oper;
+
+	PIdastar(int argc, const char *argv[]) :
+		SearchAlgorithm<D>(argc, argv) {
+		num_threads = std::thread::hardware_concurrency();
+		for (int i = 0; i < argc; i++) {
+			if (strcmp(argv[i], "-threads") == 0)
+				num_threads = strtoul(argv[++i], NULL, 10);
+			else if (strcmp(argv[i], "-tasks") == 0)
+				ntasks = strtoul(argv[++i], NULL, 10);
+		}
+		if (num_threads == 0)
+			num_threads = 1;
+		if (ntasks == 0)
+			ntasks = 1;
+	}
+
+	void search(D &d, State &s0) {
+		this->start();
+		bound = d.h(s0);
+		dfrowhdr(stdout, "iter", 6, "no", "bound",
+			"expd", "gend", "tasks", "steals");
+
+		workers.clear();
+		for (size_t i = 0; i < num_threads; i++)
+			workers.emplace_back(new Worker());
+		found.store(false);
+		stop.store(false);
+
+		for (int i = 0; !stop.load() && !SearchAlgorithm<D>::limit(); i++) {
+			minoob = Cost(-1);
+			nexpd.store(0);
+			ngend.store(0);
+			unsigned long steals = 0;
+
+			unsigned long n = split(d, s0);
+			if (!found.load() && n > 0) {
+				std::vector<std::thread> threads;
+				for (size_t t = 0; t < num_threads; t++)
+					threads.emplace_back(&PIdastar::threadloop, this, std::ref(d), t);
+				for (auto &t : threads)
+					t.join();
+
+				for (auto &w : workers) {
+					this->res.expd += w->expd;
+					this->res.gend += w->gend;
+					w->expd = w->gend = w->expdpost = w->gendpost = 0;
+					if (w->minoob != Cost(-1) && (minoob == Cost(-1) || w->minoob < minoob))
+						minoob = w->minoob;
+					steals += w->steals;
+					w->steals = 0;
+				}
+			}
+			if (found.load())
+				break;
+
+			dfrow(stdout, "iter", "dguuuu", (long) i, (double) bound,
+				this->res.expd, this->res.gend, n, steals);
+
+			if (minoob == Cost(-1))
+				break;
+			bound = minoob;
+		}
+
+		this->finish();
+	}
+
+	virtual void output(FILE *out) {
+		SearchAlgorithm<D>::output(out);
+		dfpair(out, "threads", "%lu", num_threads);
+		dfpair(out, "tasks per thread", "%lu", ntasks);
+	}
+
+private:
+
+	// A Task is the root of a subtree, with the path that leads to it.
+	struct Task {
+		State state;
+		Oper pop;
+		Cost g;
+		std::vector<State> path;	// from the initial state to the parent
+		std::vector<Oper> ops;
+	};
+
+	struct alignas(64) Worker {
+		std::mutex mtx;	// guards tasks
+		std::deque<std::unique_ptr<Task>> tasks;
+
+		unsigned long expd = 0, gend = 0, steals = 0;
+		unsigned long expdpost = 0, gendpost = 0;	// already added to nexpd and ngend
+		Cost minoob = Cost(-1);
+		std::vector<State> path;	// goal to subtree root, like Idastar's res.path
+		std::vector<Oper> ops;
+	};
+
+	// split expands the top of the tree breadth first until there
+	// are enough subtrees to keep the threads busy, then deals them
+	// out to the threads.  It returns the number of subtrees.
+	unsigned long split(D &d, State &s0) {
+		std::vector<std::unique_ptr<Task>> frontier;
+		frontier.emplace_back(new Task{s0, D::Nop, Cost(0), {}, {}});
+
+		while (!frontier.empty() && frontier.size() < ntasks * num_threads) {
+			std::vector<std::unique_ptr<Task>> next;
+			for (auto &t : frontier) {
+				Cost f = t->g + d.h(t->state);
+				if (f <= bound && d.isgoal(t->state)) {
+					solved(t->path, t->ops, t->state);
+					return 0;
+				}
+				if (f > bound) {
+					if (minoob == Cost(-1) || f < minoob)
+						minoob = f;
+					continue;
+				}
+
+				this->res.expd++;
+				typename D::Operators ops(d, t->state);
+				for (unsigned int n = 0; n < ops.size(); n++) {
+					if (ops[n] == t->pop)
+						continue;
+					this->res.gend++;
+					std::unique_ptr<Task> kid(new Task{t->state, D::Nop, Cost(0), t->path, t->ops});
+					kid->path.push_back(t->state);
+					kid->ops.push_back(ops[n]);
+					typename D::Edge e(d, t->state, ops[n]);
+					kid->state = e.state;
+					kid->pop = e.revop;
+					kid->g = t->g + e.cost;
+					next.push_back(std::move(kid));
+				}
+			}
+			frontier.swap(next);
+		}
+
+		for (unsigned long i = 0; i < frontier.size(); i++)
+			workers[i % num_threads]->tasks.push_back(std::move(frontier[i]));
+		return frontier.size();
+	}
+
+	void threadloop(D &d, size_t id) {
+		Worker &w = *workers[id];
+		w.minoob = Cost(-1);
+
+		std::unique_ptr<Task> t;
+		while (!found.load(std::memory_order_relaxed) && !stop.load(std::memory_order_relaxed) && (t = take(id))) {
+			w.path.clear();
+			w.ops.clear();
+			if (dfs(d, w, t->state, t->pop, t->g)) {
+				State s = t->state;
+				solved(t->path, t->ops, s, &w);
+			}
+		}
+		// drop what is left if the iteration ended early
+		std::lock_guard<std::mutex> lk(w.mtx);
+		w.tasks.clear();
+	}
+
+	// take pops the thread's own tasks in the order a serial IDA*
+	// would search them, or steals the last task of another thread.
+	std::unique_ptr<Task> take(size_t id) {
+		Worker &w = *workers[id];
+		{
+			std::lock_guard<std::mutex> lk(w.mtx);
+			if (!w.tasks.empty()) {
+				std::unique_ptr<Task> t = std::move(w.tasks.front());
+				w.tasks.pop_front();
+				return t;
+			}
+		}
+		for (size_t i = 1; i < num_threads; i++) {
+			Worker &v = *workers[(id + i) % num_threads];
+			std::lock_guard<std::mutex> lk(v.mtx);
+			if (!v.tasks.empty()) {
+				std::unique_ptr<Task> t = std::move(v.tasks.back());
+				v.tasks.pop_back();
+				w.steals++;
+				return t;
+			}
+		}
+		return NULL;
+	}
+
+	// solved records the solution through the given subtree root.  The
+	// path below the root, if any, is in w.
+	void solved(std::vector<State> &path, std::vector<Oper> &ops, State &root, Worker *w = NULL) {
+		std::lock_guard<std::mutex> lk(solved_mutex);
+		if (found.load())
+			return;
+		if (w) {
+			this->res.path = w->path;
+			this->res.ops = w->ops;
+		}
+		this->res.path.push_back(root);
+		for (long i = (long) path.size() - 1; i >= 0; i--) {
+			this->res.path.push_back(path[i]);
+			this->res.ops.push_back(ops[i]);
+		}
+		found.store(true);
+	}
+
+	bool dfs(D &d, Worker &w, State &s, Oper pop, Cost g) {
+		Cost f = g + d.h(s);
+
+		if (f <= bound && d.isgoal(s))
+			return true;
+
+		if (f > bound) {
+			if (w.minoob == Cost(-1) || f < w.minoob)
+				w.minoob = f;
+			return false;
+		}
+
+		w.expd++;
+		if (w.expd % PIDA_LIMIT_CHECK == 0 && limit(w))
+			return false;
+
+		typename D::Operators ops(d, s);
+		for (unsigned int n = 0; n < ops.size(); n++) {
+			if (found.load(std::memory_order_relaxed) || stop.load(std::memory_order_relaxed))
+				return false;
+			if (ops[n] == pop)
+				continue;
+
+			w.gend++;
+			bool goal = false;
+			{	// Push the child state onto the path while the
+				// Edge is in scope, before it reverts the
+				// transition.  solved adds the subtree root.
+				typename D::Edge e(d, s, ops[n]);
+				goal = dfs(d, w, e.state, e.revop, g + e.cost);
+				if (goal)
+					w.path.push_back(e.state);
+			}
+
+			if (goal) {
+				w.ops.push_back(ops[n]);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// limit adds the thread's recent expansions to the shared counts
+	// and checks them against the search limits.
+	bool limit(Worker &w) {
+		SearchStats s;
+		s.expd = this->res.expd + nexpd.fetch_add(w.expd - w.expdpost, std::memory_order_relaxed) + w.expd - w.expdpost;
+		s.gend = this->res.gend + ngend.fetch_add(w.gend - w.gendpost, std::memory_order_relaxed) + w.gend - w.gendpost;
+		w.expdpost = w.expd;
+		w.gendpost = w.gend;
+		if (this->lim.reached(s))
+			stop.store(true);
+		return stop.load();
+	}
+
+	size_t num_threads = 1;
+	unsigned long ntasks = PIDA_TASKS;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::mutex solved_mutex;
+	std::atomic<bool> found, stop;
+	std::atomic<unsigned long> nexpd, ngend;
+
+	Cost bound;
+	Cost minoob;
+};
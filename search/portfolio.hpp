@@ -0,0 +1,178 @@
+// Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+#pragma once
+#include "../search/search.hpp"
+#include "../utils/utils.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PORTFOLIO_POLL 10 // milliseconds between checks of the portfolio's time limit
+
+template<class D> SearchAlgorithm<D> *getsearch(int argc, const char *argv[]);
+
+// Portfolio runs several anytime searches, its members, on separate
+// threads against the same domain.  The members share an incumbent:
+// each prunes the nodes that cannot beat the best solution found by
+// any of them, and a member that shows the incumbent is optimal stops
+// the others.  Each -member flag gives the algorithm and arguments of
+// one member as a single argument, for example -member "wastar -wt 3".
+// Time limits apply to the whole portfolio and node limits go in the
+// member's arguments.  The domain must allow concurrent searches.
+template <class D> struct Portfolio : public SearchAlgorithm<D> {
+
+	typedef typename D::State State;
+	typedef typename D::Cost Cost;
+
+	Portfolio(int argc, const char *argv[]) :
+		SearchAlgorithm<D>(argc, argv) {
+		std::vector<std::string> specs;
+		for (int i = 0; i < argc; i++) {
+			if (i < argc - 1 && strcmp(argv[i], "-member") == 0)
+				specs.push_back(argv[++i]);
+		}
+		if (specs.empty())
+			specs = { "arastar -wt0 5 -dwt 1", "aees", "wastar -wt 3" };
+
+		for (auto &spec : specs) {
+			std::unique_ptr<Member> m(new Member());
+			m->spec = spec;
+			m->args.push_back(argv[0]);
+			for (auto &t : tokens(spec))
+				m->args.push_back(t);
+			if (m->args.size() < 2)
+				fatal("portfolio: empty member");
+			if (m->args[1] == "portfolio")
+				fatal("portfolio: a member cannot be a portfolio");
+			for (auto &a : m->args)
+				m->argv.push_back(a.c_str());
+			m->srch.reset(getsearch<D>(m->argv.size(), m->argv.data()));
+			m->srch->shared = &inc;
+			m->srch->sharedid = members.size();
+			members.push_back(std::move(m));
+		}
+	}
+
+	void search(D &d, State &s0) {
+		this->start();
+		h0 = d.h(s0);
+
+		FILE *null = fopen("/dev/null", "w");
+		if (!null)
+			fatalx(errno, "portfolio: failed to open /dev/null");
+
+		std::atomic<unsigned int> running(members.size());
+		std::vector<std::thread> threads;
+		for (auto &m : members) {
+			threads.emplace_back([&d, &s0, &running, null](Member *m) {
+				// the members' own datafile output would clash
+				dfredirect(null);
+				State s = s0;
+				try {
+					m->srch->search(d, s);
+				} catch (std::bad_alloc&) {
+					m->oom = true;
+					m->srch->finish();
+				}
+				dfredirect(NULL);
+				running--;
+			}, m.get());
+		}
+
+		while (running.load() > 0) {
+			if (this->lim.reached(this->res)) {
+				timedout = true;
+				inc.stop.store(true);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(PORTFOLIO_POLL));
+		}
+		for (auto &t : threads)
+			t.join();
+		fclose(null);
+
+		for (auto &m : members) {
+			this->res.expd += m->srch->res.expd;
+			this->res.gend += m->srch->res.gend;
+			this->res.dups += m->srch->res.dups;
+			this->res.reopnd += m->srch->res.reopnd;
+		}
+		if (!inc.sols.empty()) {
+			// a member's latest solution is its best
+			Result<D> &best = members[inc.sols.back().who]->srch->res;
+			this->res.path = best.path;
+			this->res.ops = best.ops;
+		}
+		this->finish();
+		rows();
+	}
+
+	virtual void reset() {
+		SearchAlgorithm<D>::reset();
+		for (auto &m : members) {
+			m->srch->reset();
+			m->oom = false;
+		}
+		inc.cost.store(std::numeric_limits<double>::infinity());
+		inc.stop.store(false);
+		inc.sols.clear();
+		timedout = false;
+	}
+
+	virtual void output(FILE *out) {
+		SearchAlgorithm<D>::output(out);
+		dfpair(out, "members", "%lu", (unsigned long) members.size());
+		dfpair(out, "proved optimal", "%s", inc.stop.load() && !timedout ? "yes" : "no");
+		for (unsigned int i = 0; i < members.size(); i++) {
+			Member &m = *members[i];
+			std::string key = "member " + std::to_string(i);
+			unsigned long nsols = 0;
+			for (auto &s : inc.sols)
+				nsols += s.who == i;
+			dfpair(out, key.c_str(), "%s", m.spec.c_str());
+			dfpair(out, (key + " nodes expanded").c_str(), "%lu", m.srch->res.expd);
+			dfpair(out, (key + " nodes generated").c_str(), "%lu", m.srch->res.gend);
+			dfpair(out, (key + " incumbents").c_str(), "%lu", nsols);
+			if (m.oom)
+				dfpair(out, (key + " out of memory").c_str(), "%s", "true");
+		}
+	}
+
+private:
+
+	struct Member {
+		std::string spec;
+		std::vector<std::string> args;
+		std::vector<const char*> argv;
+		std::unique_ptr<SearchAlgorithm<D>> srch;
+		bool oom = false;
+	};
+
+	// rows outputs the incumbents in the columns of ARA*'s, which
+	// the anyprof tools read.  The expansions and generations are
+	// those of the member that found the solution and the bound is
+	// relative to the initial heuristic.
+	void rows() {
+		dfrowhdr(stdout, "incumbent", 7, "num", "nodes expanded",
+			"nodes generated", "member", "solution bound", "solution cost",
+			"wall time");
+		unsigned long n = 0;
+		for (auto &s : inc.sols) {
+			double bound = h0 > 0 ? s.cost / h0 : std::numeric_limits<double>::infinity();
+			dfrow(stdout, "incumbent", "uuuuggg", ++n, s.expd, s.gend,
+				(unsigned long) s.who, bound, s.cost,
+				s.time - this->res.wallstart);
+		}
+	}
+
+	std::vector<std::unique_ptr<Member>> members;
+	Incumbent inc;
+	double h0 = 0;
+	bool timedout = false;
+};
@@ -59,7 +59,7 @@ template <class D> struct RectangleBeadSearch : public SearchAlgorithm<D> {
 		}
 
     private:
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
     
 	};
 
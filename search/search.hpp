@@ -1,7 +1,14 @@
 // Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <type_traits>
 #include <vector>
 #include <signal.h>
 
@@ -113,6 +120,15 @@ public:
 		return *p;
 	}
 
+	// front returns the node that pop would return without
+	// removing it, or NULL if the list is empty.
+	Node *front() {
+		boost::optional<Node*> p = heap.front();
+		if (!p)
+			return NULL;
+		return *p;
+	}
+
 	void pre_update(Node *n) {
 	}
 
@@ -187,6 +203,12 @@ class OpenList <Ops, Node, IntOpenCost> {
 			return n;
 		}
 
+		Node *front() {
+			for ( ; bkts[max].empty() && max > 0; max--)
+				;
+			return bkts[max].back();
+		}
+
 		void rm(Node *n, unsigned long p) {
 			assert (p < bkts.size());
 			std::vector<Node*> &bkt = bkts[p];
@@ -244,6 +266,14 @@ public:
 		return n;
 	}
 
+	Node *front() {
+		if (fill == 0)
+			return NULL;
+		for ( ; min < qs.size() && qs[min].empty(); min++)
+			;
+		return qs[min].front();
+	}
+
 	void pre_update(Node*n) {
 		if (Ops::getind(n) < 0)
 			return;
@@ -272,6 +302,151 @@ public:
 	}
 };
 
+// A RadixOpenList is an open list for searches whose priorities
+// seldom decrease from one pop to the next, such as A* with a
+// consistent heuristic.  Ops::prio returns a non-negative integer or
+// floating point key.  Bucket i > 0 holds the nodes whose key first
+// differs from last, the key of the latest node popped, in bit i-1,
+// so a node only ever moves to lower buckets.  Bucket 0 holds the
+// nodes with keys no greater than last in a binary heap ordered by
+// Ops::pred, which breaks ties and takes any node pushed below last,
+// so nodes come out in the same order as from the binary heap
+// OpenList.
+template <class Ops, class Node, class Cost>
+class RadixOpenList {
+public:
+	RadixOpenList() : fill(0), last(0) { }
+
+	static const char *kind() { return "radix heap"; }
+
+	void push(Node *n) {
+		place(n, key(n));
+		fill++;
+	}
+
+	Node *pop() {
+		if (!front())
+			return NULL;
+		fill--;
+		return *heap.pop();
+	}
+
+	// front returns the node that pop would return without
+	// removing it, or NULL if the list is empty.
+	Node *front() {
+		if (fill == 0)
+			return NULL;
+		if (heap.empty())
+			refill();
+		return *heap.front();
+	}
+
+	void pre_update(Node *n) {
+		if (Ops::getind(n) < 0)
+			return;
+		unsigned int b = bucket(key(n));
+		if (b == 0) {
+			heap.remove(n);
+		} else {
+			std::vector<Node*> &bkt = bkts[b];
+			unsigned int i = Ops::getind(n);
+			bkt[i] = bkt.back();
+			Ops::setind(bkt[i], i);
+			bkt.pop_back();
+			Ops::setind(n, -1);
+		}
+		fill--;
+	}
+
+	void post_update(Node *n) {
+		assert (Ops::getind(n) < 0);
+		push(n);
+	}
+
+	bool empty() {
+		return fill == 0;
+	}
+
+	unsigned long size() {
+		return fill;
+	}
+
+	bool mem(Node *n) {
+		return Ops::getind(n) >= 0;
+	}
+
+	void clear() {
+		heap.clear();
+		for (auto &bkt : bkts)
+			bkt.clear();
+		fill = 0;
+		last = 0;
+	}
+
+private:
+
+	// key maps the priority to an integer of the same order.  The
+	// bits of a non-negative double already sort as integers.
+	static uint64_t key(Node *n) {
+		auto p = Ops::prio(n);
+		if constexpr (std::is_integral_v<decltype(p)>) {
+			assert (p >= 0);
+			return p;
+		} else {
+			double d = (double) p + 0.0;	// no -0
+			assert (d >= 0);
+			uint64_t k;
+			memcpy(&k, &d, sizeof(k));
+			return k;
+		}
+	}
+
+	unsigned int bucket(uint64_t k) const {
+		if (k <= last)
+			return 0;
+		return 64 - __builtin_clzll(k ^ last);
+	}
+
+	void place(Node *n, uint64_t k) {
+		unsigned int b = bucket(k);
+		if (b == 0) {
+			heap.push(n);
+			return;
+		}
+		Ops::setind(n, bkts[b].size());
+		bkts[b].push_back(n);
+	}
+
+	// refill makes last the least key in the lowest non-empty
+	// bucket and spreads that bucket over the lower ones, at least
+	// one node landing in bucket 0.
+	void refill() {
+		unsigned int b = 1;
+		while (bkts[b].empty())
+			b++;
+		std::vector<Node*> &bkt = bkts[b];
+		last = key(bkt[0]);
+		for (Node *n : bkt)
+			last = std::min(last, key(n));
+		for (Node *n : bkt)
+			place(n, key(n));
+		bkt.clear();
+	}
+
+	struct Heapops {
+		static bool pred(Node *a, Node *b) { return Ops::pred(a, b); }
+
+		static void setind(Node *n, int i) { Ops::setind(n, i); }
+
+		static int getind(Node *n) { return Ops::getind(n); }
+	};
+
+	unsigned long fill;
+	uint64_t last;
+	BinHeap<Heapops, Node*> heap;
+	std::vector<Node*> bkts[65];
+};
+
 // A MinMaxOpenList holds nodes and returns the min or max ordered
 // by some priority.  The Ops class has a pred method which accepts
 // two Nodes and returns true if the 1st node is a predecessor
@@ -337,6 +512,40 @@ private:
 };
 
 
+// An Incumbent is the best solution cost of several searches that run
+// on separate threads, see Portfolio.  Each search prunes the nodes
+// that cannot beat it and offers it the solutions that it finds.
+class Incumbent {
+public:
+	// A Sol is a solution offered by one of the searches.
+	struct Sol {
+		unsigned int who;
+		double cost, time;
+		unsigned long expd, gend;
+	};
+
+	Incumbent() : cost(std::numeric_limits<double>::infinity()), stop(false) { }
+
+	// improve records a solution of the given cost found by search
+	// who after the given number of expansions and generations.  It
+	// returns false if the incumbent is already as good.
+	bool improve(unsigned int who, double c, unsigned long expd, unsigned long gend) {
+		std::lock_guard<std::mutex> lk(mtx);
+		if (c >= cost.load(std::memory_order_relaxed))
+			return false;
+		cost.store(c, std::memory_order_relaxed);
+		sols.push_back(Sol{who, c, walltime(), expd, gend});
+		return true;
+	}
+
+	std::atomic<double> cost;
+	std::atomic<bool> stop;	// the searches must stop
+	std::vector<Sol> sols;	// guarded by mtx, in order of decreasing cost
+
+private:
+	std::mutex mtx;
+};
+
 // A Result is returned from a completed search.  It contains
 // statistical information about the search along with the
 // solution cost and solution path if a goal was found.
@@ -383,6 +592,67 @@ void solpath(D &d, Node *goal, Result<D> &res) {
 	}
 }
 
+// A BatchHeuristic domain computes the heuristic of several states
+// with one call, h_batch(states, n, out).  See search/domain_template.
+template <class D> concept BatchHeuristic = requires(D &d, typename D::State *ss, typename D::Cost *hs) {
+	d.h_batch(ss, 0u, hs);
+};
+
+// A HeuristicBatch gathers the new children of an expansion so that
+// their heuristics are computed by a single call to the domain's
+// h_batch.  For other domains each heuristic is computed as soon as
+// the child is added, while its Edge is still in scope, so the
+// children are handled in the same order either way.
+template <class D, class Node>
+class HeuristicBatch {
+public:
+	typedef typename D::State State;
+	typedef typename D::Cost Cost;
+
+	// add sets n->f to n->g plus the heuristic of s and then calls
+	// done(n, h), now or at the next flush.  s is copied if needed,
+	// so the Edge may be undone before the flush.
+	template <class Done> void add(D &d, State &s, Node *n, Done done) {
+		if constexpr (BatchHeuristic<D>) {
+			states.push_back(s);
+			nodes.push_back(n);
+		} else {
+			Cost h = d.h(s);
+			n->f = n->g + h;
+			done(n, h);
+		}
+	}
+
+	// pending returns true if n was added but not yet flushed, its
+	// f is not set yet and its done has not been called.
+	bool pending(const Node *n) const {
+		if constexpr (BatchHeuristic<D>)
+			return std::find(nodes.begin(), nodes.end(), n) != nodes.end();
+		return false;
+	}
+
+	// flush finishes the children added since the last flush.
+	template <class Done> void flush(D &d, Done done) {
+		if constexpr (BatchHeuristic<D>) {
+			if (states.empty())
+				return;
+			hs.resize(states.size());
+			d.h_batch(states.data(), states.size(), hs.data());
+			for (unsigned int i = 0; i < nodes.size(); i++) {
+				nodes[i]->f = nodes[i]->g + hs[i];
+				done(nodes[i], hs[i]);
+			}
+			states.clear();
+			nodes.clear();
+		}
+	}
+
+private:
+	std::vector<State> states;
+	std::vector<Node*> nodes;
+	std::vector<Cost> hs;
+};
+
 template <class D>
 class SearchAlgorithm {
 public:
@@ -412,9 +682,34 @@ public:
 	}
 
 	bool limit() {
-		return lim.reached(res);
+		return lim.reached(res) || (shared && shared->stop.load(std::memory_order_relaxed));
+	}
+
+	// pruned returns true if a node with the given f value cannot
+	// beat the shared incumbent, if there is one.
+	bool pruned(double f) {
+		return shared && f >= shared->cost.load(std::memory_order_relaxed);
+	}
+
+	// report offers a solution of the given cost to the shared
+	// incumbent, if there is one.
+	void report(double cost) {
+		if (shared)
+			shared->improve(sharedid, cost, res.expd, res.gend);
+	}
+
+	// proved stops the other searches sharing the incumbent once this
+	// search has shown that nothing beats it.
+	void proved() {
+		if (shared)
+			shared->stop.store(true);
 	}
 
 	Result<D> res;
 	Limit lim;
+
+	// shared is the incumbent of a Portfolio that this search is run
+	// by, and sharedid is its number in the portfolio.
+	Incumbent *shared = NULL;
+	unsigned int sharedid = 0;
 };
@@ -10,7 +10,8 @@
 #include <vector>
 #include <memory>
 #include <mutex> // yay pain
-#include <barrier>
+
+#define SPA_CLOSED_SHARDS 256 // closed list stripes, each with its own lock
 
 template <class D> struct SPAstar : public SearchAlgorithm<D> {
 
@@ -38,8 +39,10 @@ template <class D> struct SPAstar : public SearchAlgorithm<D> {
 		PackedState state;
 		Oper op, pop;
 		Cost f, g;
+		std::atomic<bool> stale;    // a better path to the state was found, skip it
+		std::atomic<bool> expanded; // popped for expansion
 
-		Node() : openind(-1) {
+		Node() : openind(-1), stale(false), expanded(false) {
 		}
 
 		static PackedState &key(Node *n) {
@@ -70,16 +73,16 @@ template <class D> struct SPAstar : public SearchAlgorithm<D> {
 	};
 
 	SPAstar(int argc, const char *argv[]) :
-		SearchAlgorithm<D>(argc, argv) {
+		SearchAlgorithm<D>(argc, argv), shards(new Shard[SPA_CLOSED_SHARDS]) {
 		for (int i = 0; i < argc; i++) {
 			if (strcmp(argv[i], "-threads") == 0){
 				num_threads = strtod(argv[++i], NULL);
 				if(num_threads <= 0 ) {
 					exit(1);
 				}
-				if (strcmp(argv[i], "-exp") == 0){
-					extra_calcs = strtod(argv[++i], NULL);
-				}
+			}
+			if (strcmp(argv[i], "-exp") == 0){
+				extra_calcs = strtod(argv[++i], NULL);
 			}
 		}
 	}
@@ -87,66 +90,77 @@ template <class D> struct SPAstar : public SearchAlgorithm<D> {
 	~SPAstar() {
 	}
 
-	void threadloop(std::atomic<bool> &found, D &d, size_t id, std::barrier<> &barrier, Pool<Node> * nodes) {
-		// std::cerr << "Thread " << id << " started" << std::endl;
-		// wait for all threads to start
-		barrier.arrive_and_wait();
-		num_working_threads.fetch_add(1);
-		while (!(found.load()) && num_working_threads.load() >= 1) { // 1 thread because self
-			std::unique_lock<std::mutex> open_lock(open_mutex);
-			Node *n = open.pop();
-			open_lock.unlock();
-			// if failed to get a node, then continue
+	// threadloop alternates between one critical section on open and
+	// one expansion.  The critical section pushes the children of the
+	// last expansion, records a goal, and pops the next node, so open
+	// and the nodes in flight always hold the frontier together.
+	void threadloop(D &d, size_t id, Pool<Node> * nodes) {
+		std::vector<Node*> kids;
+		Counts counts;
+		Node *goal_node = NULL;
+		for (;;) {
+			Node *n;
+			{
+				std::lock_guard<std::mutex> open_lock(open_mutex);
+				for (Node *kid : kids)
+					open.push(kid);
+				kids.clear();
+				this->res.expd += counts.expd;
+				this->res.gend += counts.gend;
+				this->res.dups += counts.dups;
+				this->res.reopnd += counts.reopnd;
+				counts = Counts();
+				if (goal_node && (!incumbent || goal_node->g < incumbent->g)) {
+					incumbent = goal_node;
+					solutions++;
+				}
+				goal_node = NULL;
+				inflight[id] = NULL;
+				n = next();
+				if (done)
+					return;
+				inflight[id] = n;
+			}
+			// if failed to get a node, then wait for the nodes in flight
 			if (n == NULL) {
-				// std::cerr << "Thread " << id << " failed to get a node" << std::endl;
+				std::this_thread::yield();
 				continue;
 			}
 			State buf, &state = d.unpack(buf, n->state);
 			if (d.isgoal(state)) {
-				// std::cerr << "Thread " << id << " found a solution" << std::endl;
-				found.store(true);
-				auto goal_ptr = goal.load();
-				if (goal_ptr == nullptr || n->g < goal_ptr->g) {
-					goal.store(std::make_shared<Node>(*n));
-				}
-				break;
+				goal_node = n;
+				continue;
 			}
-			expand(d, n, state, nodes);
+			expand(d, n, state, nodes, kids, counts);
 		}
-		// std::cerr << "Thread " << id << " finished" << std::endl;
-		num_working_threads.fetch_sub(1);
 	}
 
 	void search(D &d, typename D::State &s0) {
 		this->start();
-		//closed.init(d);
 
-		auto found = std::atomic<bool>(false);
-		// init barrier to size of threads
-		std::barrier<> barrier(num_threads);
+		pools.clear();
+		pools.emplace_back(new Pool<Node>());
+		Node * n0 = init(d, s0, pools[0].get());
+		shard(n0->state).closed[n0->state] = n0;
+		open.push(n0);
+		inflight.assign(num_threads, NULL);
+		incumbent = NULL;
+		done = false;
 
-		std::vector<Pool<Node>* > pools;
-		
+		std::vector<std::jthread> threads;
 		for (size_t i = 0; i < num_threads; i++){
-			pools.push_back(new Pool<Node>());
-			threads.emplace_back(&SPAstar::threadloop, this, std::ref(found), std::ref(d), i, std::ref(barrier), pools[i]);
+			if (i > 0)
+				pools.emplace_back(new Pool<Node>());
+			threads.emplace_back(&SPAstar::threadloop, this, std::ref(d), i, pools[i].get());
 		}
 
-		Pool<Node> * nodes = new Pool<Node>();
-		Node * n0 = init(d, s0, nodes);
-		closed[n0->state] =  n0;
-		open.push(n0);
-
 		// wait till all threads are done
 		for (auto &thread : threads) {
 			thread.join();
 		}
 
-		// std::cerr << "All threads are done" << std::endl;
-
-		auto goal_ptr = goal.load();
-		if (goal_ptr != nullptr) {
-			solpath<D, Node>(d, goal_ptr.get(), this->res);
+		if (incumbent != NULL) {
+			solpath<D, Node>(d, incumbent, this->res);
 		}
 		this->finish();
 	}
@@ -154,7 +168,10 @@ template <class D> struct SPAstar : public SearchAlgorithm<D> {
 	virtual void reset() {
 		SearchAlgorithm<D>::reset();
 		open.clear();
-		closed.clear();
+		for (size_t i = 0; i < SPA_CLOSED_SHARDS; i++)
+			shards[i].closed.clear();
+		pools.clear();
+		solutions = 0;
 	}
 
 	virtual void output(FILE *out) {
@@ -162,18 +179,67 @@ template <class D> struct SPAstar : public SearchAlgorithm<D> {
 		//closed.prstats(stdout, "closed ");
 		dfpair(stdout, "open list type", "%s", open.kind());
 		dfpair(stdout, "node size", "%u", sizeof(Node));
+		dfpair(stdout, "closed shards", "%u", SPA_CLOSED_SHARDS);
+		dfpair(stdout, "incumbent solutions", "%lu", solutions);
 	}
 
 private:
 
-	void expand(D &d, Node *n, State &state, Pool<Node> * nodes) {
-		SearchAlgorithm<D>::res.expd++;
+	struct Counts {
+		unsigned long expd = 0, gend = 0, dups = 0, reopnd = 0;
+	};
+
+	struct alignas(64) Shard {
+		std::mutex mtx;
+		boost::unordered_flat_map<PackedState, Node *, StateHasher, StateEq> closed;
+	};
+
+	Shard &shard(const PackedState &s) {
+		return shards[StateHasher()(s) % SPA_CLOSED_SHARDS];
+	}
+
+	// next pops the next node worth expanding, open_mutex must be
+	// held.  It returns NULL and sets done once the incumbent costs no
+	// more than every f on open and in flight, which keeps the A*
+	// guarantee, and it returns NULL without setting done if open is
+	// empty but other threads may still add to it.
+	Node *next() {
+		if (SearchAlgorithm<D>::limit()) {
+			done = true;
+			return NULL;
+		}
+		for (;;) {
+			Node *n = open.pop();
+			if (n == NULL) {
+				done = true;
+				for (Node *m : inflight)
+					done = done && m == NULL;
+				return NULL;
+			}
+			if (n->stale.load(std::memory_order_relaxed))
+				continue;
+			if (incumbent && n->f >= incumbent->g) {
+				// open holds nothing better, stop once the nodes in flight are no better either
+				done = true;
+				for (Node *m : inflight)
+					done = done && (m == NULL || m->f >= incumbent->g);
+				if (done)
+					return NULL;
+				continue;
+			}
+			n->expanded.store(true, std::memory_order_relaxed);
+			return n;
+		}
+	}
+
+	void expand(D &d, Node *n, State &state, Pool<Node> * nodes, std::vector<Node*> &kids, Counts &counts) {
+		counts.expd++;
 
 		typename D::Operators ops(d, state);
 		for (unsigned int i = 0; i < ops.size(); i++) {
 			if (ops[i] == n->pop)
 				continue;
-			SearchAlgorithm<D>::res.gend++;
+			counts.gend++;
 			Node *kid = nodes->construct();
 
 			assert (kid);
@@ -182,46 +248,40 @@ private:
 			kid->g = n->g + e.cost;
 			d.pack(kid->state, e.state);
 
-			// unsigned long hash = kid->state.hash(&d);
-			//lock open and closed
-			std::lock_guard<std::mutex> open_lock(open_mutex);
-			std::lock_guard<std::mutex> closed_lock(closed_mutex);
-			auto dupl = closed.find(kid->state);
-			if (dupl != closed.end()) {
-				Node * dup = dupl->second;
-				this->res.dups++;
-				if (kid->g >= dup->g) {
-					nodes->destruct(kid);
-					continue;
-				}
-				bool isopen = open.mem(dup);
-				if (isopen)
-					open.pre_update(dup);
-				dup->f = dup->f - dup->g + kid->g;
-				dup->g = kid->g;
-				dup->parent = n;
-				dup->op = op;
-				dup->pop = e.revop;
-				if (isopen) {
-					open.post_update(dup);
+			// only this state's shard is locked, a better path gets
+			// a new node and the old one goes stale on open
+			{
+				Shard &sh = shard(kid->state);
+				std::lock_guard<std::mutex> closed_lock(sh.mtx);
+				auto dupl = sh.closed.find(kid->state);
+				if (dupl != sh.closed.end()) {
+					Node * dup = dupl->second;
+					counts.dups++;
+					if (kid->g >= dup->g) {
+						nodes->destruct(kid);
+						continue;
+					}
+					if (dup->expanded.load(std::memory_order_relaxed))
+						counts.reopnd++;
+					dup->stale.store(true, std::memory_order_relaxed);
+					dupl->second = kid;
 				} else {
-					this->res.reopnd++;
-					open.push(dup);
+					sh.closed.emplace(kid->state, kid);
 				}
-				nodes->destruct(kid);
-				continue;
 			}
 
 			kid->f = kid->g + d.h(e.state);
 			kid->parent = n;
 			kid->op = op;
 			kid->pop = e.revop;
-
-			// should be covered by lock guards above
-			closed[kid->state] = kid;
-			open.push(kid);
-
+			kids.push_back(kid); // pushed on open with the rest in one go
 		}
+
+		// -exp adds busy work to each expansion, as in cafe
+		size_t s_i = 0;
+		volatile size_t *sum_i = &s_i;
+		for (size_t j = 0; j < extra_calcs; j++)
+			*sum_i = *sum_i + j;
 	}
 
 	Node *init(D &d, State &s0, Pool<Node> * nodes) {
@@ -235,20 +295,19 @@ private:
 	}
 
 	size_t num_threads = 1;
-	std::atomic<size_t> num_working_threads = 0;
-	std::vector<std::jthread> threads;
-	std::atomic<std::shared_ptr<Node>> goal;
-
 
 	size_t extra_calcs = 0;
-	std::atomic<double> total_sum = 0;
 
-	// mutexes
-	std::mutex open_mutex;
-	std::mutex closed_mutex;
-	std::mutex nodes_mutex;
+	// one node pool per thread, the first also holds the root
+	std::vector<std::unique_ptr<Pool<Node>>> pools;
 
+	// guarded by open_mutex
+	std::mutex open_mutex;
 	OpenList<Node, Node, Cost> open;
- 	// ClosedList<Node, Node, D> closed;
-	boost::unordered_flat_map<PackedState, Node *, StateHasher, StateEq> closed;
+	std::vector<Node*> inflight; // node each thread is expanding, NULL if none
+	Node *incumbent = NULL;      // best goal popped so far
+	unsigned long solutions = 0; // times the incumbent improved
+	bool done = false;
+
+	std::unique_ptr<Shard[]> shards;
 };
@@ -9,6 +9,16 @@ bool closedlist_find_test();
 bool closedlist_rm_test();
 bool closedlist_find_rand_test();
 bool closed_iter_test();
+bool closedlist_grow_test();
+bool openclosed_churn_test();
+bool openclosed_find_rand_test();
+bool cafeheap_binary_pop_test();
+bool cafeheap_dary_pop_test();
+bool cafeheap_binary_decrease_test();
+bool cafeheap_dary_decrease_test();
+bool incumbent_improve_test();
+bool radixopen_float_test();
+bool radixopen_int_test();
 
 
 static const Test tests[] = {
@@ -17,13 +27,31 @@ static const Test tests[] = {
 	Test("closed list rm test", closedlist_rm_test),
 	Test("closed list find rand test", closedlist_find_rand_test),
 	Test("closed iter test", closed_iter_test),
+	Test("closed list grow test", closedlist_grow_test),
+	Test("open closed list churn test", openclosed_churn_test),
+	Test("open closed list find rand test", openclosed_find_rand_test),
+	Test("cafe binary heap pop test", cafeheap_binary_pop_test),
+	Test("cafe d-ary heap pop test", cafeheap_dary_pop_test),
+	Test("cafe binary heap decrease test", cafeheap_binary_decrease_test),
+	Test("cafe d-ary heap decrease test", cafeheap_dary_decrease_test),
+	Test("incumbent improve test", incumbent_improve_test),
+	Test("radix open list float test", radixopen_float_test),
+	Test("radix open list int test", radixopen_int_test),
 };
 
 enum { Ntests = sizeof(tests) / sizeof(tests[0]) };
 
-//static const Benchmark benches[] = {};
+void cafeheap_binary_pop_bench(unsigned long, double*, double*);
+void cafeheap_4ary_pop_bench(unsigned long, double*, double*);
+void cafeheap_8ary_pop_bench(unsigned long, double*, double*);
 
-//enum { Nbenches = sizeof(benches) / sizeof(benches[0]) };
+static const Benchmark benches[] = {
+	Benchmark("cafe binary heap pop benchmark", cafeheap_binary_pop_bench),
+	Benchmark("cafe 4-ary heap pop benchmark", cafeheap_4ary_pop_bench),
+	Benchmark("cafe 8-ary heap pop benchmark", cafeheap_8ary_pop_bench),
+};
+
+enum { Nbenches = sizeof(benches) / sizeof(benches[0]) };
 
 int main(int argc, const char *argv[]) {
 	const char *regexp = ".*";
@@ -33,7 +61,7 @@ int main(int argc, const char *argv[]) {
 	srand(time(NULL));
 
 	bool ok = runtests(tests, Ntests, regexp);
-//	runbenches(benches, Nbenches, regexp);
+	runbenches(benches, Nbenches, regexp);
 
 	return ok ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+// © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+
+#include "../utils/utils.hpp"
+#include "../Cafe_Heap/cafe_heap2.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+struct HNode {
+	int f, g;
+
+	friend std::ostream &operator<<(std::ostream &o, const HNode &n) {
+		return o << "[f:" << n.f << ", g:" << n.g << "]";
+	}
+};
+
+struct HNodeComp {
+	bool operator()(const HNode &a, const HNode &b) const {
+		if (a.f == b.f)
+			return a.g > b.g;
+		return a.f < b.f;
+	}
+};
+
+typedef HeapNode<HNode, HNodeComp> HeapEnt;
+
+enum { N = 1000, Window = 8 };
+
+static void randnodes(std::vector<HeapEnt> &nodes) {
+	for (auto &n : nodes) {
+		n.search_node.f = rand() % 100;
+		n.search_node.g = rand() % 10;
+	}
+}
+
+template <class Heap> static bool cafeheap_pop_test() {
+	bool res = true;
+	Heap heap(N, Window, Window);
+	std::vector<HeapEnt> nodes(N);
+	randnodes(nodes);
+
+	for (auto &n : nodes)
+		heap.push(&n);
+	if (!heap.heap_property() || !heap.check_handles()) {
+		testpr("Bad heap after %u pushes\n", N);
+		res = false;
+	}
+
+	HNode prev = heap.get(0)->search_node;
+	for (unsigned int i = 0; i < N; i++) {
+		HNode cur = heap.get(0)->search_node;
+		if (HNodeComp()(cur, prev)) {
+			testpr("f=%d g=%d came out after f=%d g=%d\n", cur.f, cur.g, prev.f, prev.g);
+			res = false;
+		}
+		prev = cur;
+		heap.pop();
+		if (heap.get_size() != (unsigned long) N - (i+1)) {
+			testpr("Expected fill of %u got %lu\n", N-(i+1), heap.get_size());
+			res = false;
+		}
+		if (i % 100 == 0 && !heap.check_handles()) {
+			testpr("Bad handles after %u pops\n", i+1);
+			res = false;
+		}
+	}
+	return res && heap.empty();
+}
+
+template <class Heap> static bool cafeheap_decrease_test() {
+	bool res = true;
+	Heap heap(N, Window, Window);
+	std::vector<HeapEnt> nodes(N), better(N);
+	randnodes(nodes);
+
+	for (auto &n : nodes)
+		heap.push(&n);
+
+	for (unsigned int i = 0; i < N; i += 3) {
+		better[i].search_node = nodes[i].search_node;
+		better[i].search_node.f -= rand() % 20;
+		heap.decrease_key(nodes[i].handle, &better[i]);
+		if (heap.contains(&nodes[i]) || !heap.contains(&better[i])) {
+			testpr("Node %u was not replaced\n", i);
+			res = false;
+		}
+	}
+	if (!heap.heap_property() || !heap.check_handles()) {
+		testpr("Bad heap after decrease_key\n");
+		res = false;
+	}
+	return res;
+}
+
+bool cafeheap_binary_pop_test() {
+	return cafeheap_pop_test<CafeMinBinaryHeap<HNode, HNodeComp>>();
+}
+
+bool cafeheap_dary_pop_test() {
+	return cafeheap_pop_test<CafeDaryHeap<HNode, HNodeComp, 4>>() &&
+		cafeheap_pop_test<CafeDaryHeap<HNode, HNodeComp, 8>>();
+}
+
+bool cafeheap_binary_decrease_test() {
+	return cafeheap_decrease_test<CafeMinBinaryHeap<HNode, HNodeComp>>();
+}
+
+bool cafeheap_dary_decrease_test() {
+	return cafeheap_decrease_test<CafeDaryHeap<HNode, HNodeComp, 4>>() &&
+		cafeheap_decrease_test<CafeDaryHeap<HNode, HNodeComp, 8>>();
+}
+
+// The pop benchmarks fill a heap with n nodes pushed in a random order,
+// so that neighbouring entries point far apart like in a search, then
+// time a pop followed by two pushes of worse nodes, n times.
+template <class Heap> static void cafeheap_pop_bench(unsigned long n, double *strt, double *end) {
+	Heap heap(3*n, Window, Window);
+	std::vector<HeapEnt> nodes(3*n);
+	randnodes(nodes);
+	std::vector<HeapEnt*> order(n);
+	for (unsigned long i = 0; i < n; i++)
+		order[i] = &nodes[i];
+	std::shuffle(order.begin(), order.end(), std::mt19937(rand()));
+	for (auto hn : order)
+		heap.push(hn);
+
+	*strt = walltime();
+
+	for (unsigned long i = 0; i < n; i++) {
+		HNode top = heap.get(0)->search_node;
+		heap.pop();
+		for (unsigned long j = n + 2*i; j < n + 2*i + 2; j++) {
+			nodes[j].search_node.f += top.f;
+			heap.push(&nodes[j]);
+		}
+	}
+
+	*end = walltime();
+}
+
+void cafeheap_binary_pop_bench(unsigned long n, double *strt, double *end) {
+	cafeheap_pop_bench<CafeMinBinaryHeap<HNode, HNodeComp>>(n, strt, end);
+}
+
+void cafeheap_4ary_pop_bench(unsigned long n, double *strt, double *end) {
+	cafeheap_pop_bench<CafeDaryHeap<HNode, HNodeComp, 4>>(n, strt, end);
+}
+
+void cafeheap_8ary_pop_bench(unsigned long n, double *strt, double *end) {
+	cafeheap_pop_bench<CafeDaryHeap<HNode, HNodeComp, 8>>(n, strt, end);
+}
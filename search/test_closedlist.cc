@@ -165,4 +165,121 @@ bool closed_iter_test() {
 			return false;
 	}
 	return cnt == closed.getFill();
-}
\ No newline at end of file
+}
+
+// Adds and removes keys while the table grows from a tiny size, so
+// that every lookup runs with some bins still to be moved.
+bool closedlist_grow_test() {
+	bool res = true;
+	ClosedList<Ent, Ent, Ent> closed(7);
+	Ent ents[N];
+
+	for (unsigned int i = 0; i < N; i++) {
+		ents[i] = Ent(i);
+		closed.add(ents + i);
+		if (i % 5 == 4 && closed.remove(ents[i - 2]) != ents + i - 2) {
+			testpr("Failed to remove key %u after %u adds\n", i - 2, i + 1);
+			return false;
+		}
+		for (unsigned int j = 0; j <= i; j++) {
+			bool rmed = j % 5 == 2 && j + 2 <= i;
+			Ent *vlp = closed.find(ents[j]);
+			if (!rmed && vlp != ents + j) {
+				testpr("No value mapped to key %u after %u adds\n", j, i + 1);
+				return false;
+			}
+			if (rmed && vlp) {
+				testpr("Removed key %u found after %u adds\n", j, i + 1);
+				return false;
+			}
+		}
+	}
+
+	unsigned long cnt = 0;
+	for (auto it : closed) {
+		if (it != ents + it->vl)
+			res = false;
+		cnt++;
+	}
+	if (cnt != N - N / 5 || closed.getFill() != cnt) {
+		testpr("Iterated over %lu entries, fill %lu, expected %u\n", cnt, closed.getFill(), N - N / 5);
+		res = false;
+	}
+	return res;
+}
+
+// Removes and re-adds half of the entries many times, so that the
+// table fills with deleted slots and must be rehashed in place.
+bool openclosed_churn_test() {
+	bool res = true;
+	OpenClosedList<Ent, Ent, Ent> closed(100);
+	Ent ents[N];
+
+	for (unsigned int i = 0; i < N; i++) {
+		ents[i] = Ent(i);
+		closed.add(ents + i);
+	}
+
+	for (unsigned int round = 0; round < 50; round++) {
+		for (unsigned int i = round % 2; i < N; i += 2) {
+			if (closed.remove(ents[i]) != ents + i) {
+				testpr("Round %u: failed to remove key %u\n", round, i);
+				return false;
+			}
+		}
+		if (closed.getFill() != N / 2) {
+			testpr("Round %u: expected fill %u, got %lu\n", round, N / 2, closed.getFill());
+			return false;
+		}
+		for (unsigned int i = round % 2; i < N; i += 2)
+			closed.add(ents + i);
+	}
+
+	for (unsigned int i = 0; i < N; i++) {
+		if (closed.find(ents[i]) != ents + i) {
+			testpr("No value mapped to key %u\n", i);
+			res = false;
+		}
+	}
+	Ent missing(N);
+	if (closed.find(missing)) {
+		testpr("Found key %u that was never added\n", N);
+		res = false;
+	}
+
+	unsigned long cnt = 0;
+	for (auto it : closed) {
+		if (it != ents + it->vl)
+			res = false;
+		cnt++;
+	}
+	if (cnt != N) {
+		testpr("Iterated over %lu entries, expected %u\n", cnt, N);
+		res = false;
+	}
+	return res;
+}
+
+bool openclosed_find_rand_test() {
+	bool res = true;
+	OpenClosedList<Ent, Ent, Ent> closed(16);
+	Rand r(time(NULL));
+	Ent ents[N];
+
+	for (unsigned int i = 0; i < N; i++) {
+		ents[i] = Ent(r.bits());
+		if (closed.find(ents[i]))
+			continue;	// a repeated random key
+		closed.add(ents + i);
+	}
+
+	for (unsigned int i = 0; i < N; i++) {
+		Ent *vlp = closed.find(ents[i]);
+		if (!vlp || vlp->vl != ents[i].vl) {
+			testpr("No value mapped to key ents[%u] %u\n", i, ents[i].vl);
+			res = false;
+		}
+	}
+
+	return res;
+}
@@ -0,0 +1,45 @@
+// © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+
+#include "../utils/utils.hpp"
+#include "search.hpp"
+#include <thread>
+#include <vector>
+
+static const unsigned int N = 1000, Nthreads = 4;
+
+// Several threads offer interleaved costs, the incumbent must end at
+// the least and record a strictly decreasing run of solutions.
+bool incumbent_improve_test() {
+	Incumbent inc;
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < Nthreads; t++) {
+		threads.emplace_back([&inc, t]() {
+			for (unsigned int i = 0; i < N; i++)
+				inc.improve(t, (double) ((N - i) * Nthreads + t), i, i);
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+
+	bool res = true;
+	if (inc.cost.load() != (double) Nthreads) {
+		testpr("Expected a cost of %u, got %g\n", Nthreads, inc.cost.load());
+		res = false;
+	}
+	if (inc.sols.empty() || inc.sols.back().cost != inc.cost.load()) {
+		testpr("The last solution is not the incumbent\n");
+		res = false;
+	}
+	for (unsigned int i = 1; i < inc.sols.size(); i++) {
+		if (inc.sols[i].cost >= inc.sols[i-1].cost) {
+			testpr("Solution %u, cost %g, does not improve on %g\n", i,
+				inc.sols[i].cost, inc.sols[i-1].cost);
+			res = false;
+		}
+	}
+	if (inc.improve(0, (double) Nthreads, 0, 0)) {
+		testpr("An equal cost improved the incumbent\n");
+		res = false;
+	}
+	return res;
+}
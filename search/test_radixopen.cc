@@ -0,0 +1,88 @@
+// © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+
+#include "../utils/utils.hpp"
+#include "search.hpp"
+#include <vector>
+
+template <class Cost> struct Rnode {
+	Cost f, g;
+	int openind = -1;
+	bool live = false;
+
+	static bool pred(Rnode *a, Rnode *b) {
+		if (a->f == b->f)
+			return a->g > b->g;
+		return a->f < b->f;
+	}
+
+	static Cost prio(Rnode *n) { return n->f; }
+
+	static void setind(Rnode *n, int i) { n->openind = i; }
+
+	static int getind(const Rnode *n) { return n->openind; }
+};
+
+enum { N = 3000 };
+
+// Pops nodes and pushes children with keys mostly at or above the
+// popped one, some below it, and lowers the keys of some open nodes.
+// Every pop must be a least node by pred among those on the list.
+template <class Cost> static bool radixopen_order_test(Cost step) {
+	typedef Rnode<Cost> Node;
+	RadixOpenList<Node, Node, Cost> open;
+	std::vector<Node> nodes(N);
+	unsigned int nused = 0;
+
+	auto push = [&](Cost f) {
+		Node *n = &nodes[nused++];
+		n->f = f;
+		n->g = step * (Cost) (randgen.integer(0, 9));
+		n->live = true;
+		open.push(n);
+	};
+
+	push(step * (Cost) 10);
+	unsigned long npop = 0;
+	while (!open.empty()) {
+		Node *n = open.pop();
+		if (!n || !n->live || open.mem(n)) {
+			testpr("Pop %lu returned a bad node\n", npop);
+			return false;
+		}
+		n->live = false;
+		npop++;
+		for (unsigned int i = 0; i < nused; i++) {
+			if (nodes[i].live && Node::pred(&nodes[i], n)) {
+				testpr("Pop %lu was not the least node\n", npop);
+				return false;
+			}
+		}
+
+		for (unsigned int k = 0; k < 3 && nused < N; k++) {
+			long d = randgen.integer(0, 9) - 1;
+			Cost f = d < 0 && n->f >= step ? n->f - step : n->f + step * (Cost) (d < 0 ? 0 : d);
+			push(f);
+		}
+
+		Node *u = &nodes[randgen.integer(0, nused - 1)];
+		if (u->live && u->f >= step) {
+			open.pre_update(u);
+			u->f = u->f - step;
+			open.post_update(u);
+		}
+	}
+
+	if (npop != nused) {
+		testpr("Popped %lu of %u nodes\n", npop, nused);
+		return false;
+	}
+	return true;
+}
+
+bool radixopen_float_test() {
+	return radixopen_order_test<float>(0.5f);
+}
+
+bool radixopen_int_test() {
+	return radixopen_order_test<int>(1);
+}
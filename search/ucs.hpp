@@ -11,7 +11,7 @@ template <class D> struct UniformCost : public SearchAlgorithm<D> {
 	typedef typename D::Oper Oper;
 	
 	struct Node {
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 		int openind;
 		Node *parent;
 		PackedState state;
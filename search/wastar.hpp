@@ -13,7 +13,7 @@ template <class D> struct Wastar : public SearchAlgorithm<D> {
 
 	struct Node {
 
-		ClosedEntry<Node, D> closedent;
+		[[no_unique_address]] ClosedEntry<Node, D> closedent;
 		int openind;
 		Node *parent;
 		PackedState state;
@@ -48,6 +48,10 @@ template <class D> struct Wastar : public SearchAlgorithm<D> {
 			}
 			return a->fprime < b->fprime;
 		}	
+
+		static double prio(Node *n) {
+			return n->fprime;
+		}
 	};
 
 	Wastar(int argc, const char *argv[]) :
@@ -79,16 +83,23 @@ template <class D> struct Wastar : public SearchAlgorithm<D> {
 		open.push(n0);
 
 		while (!open.empty() && !SearchAlgorithm<D>::limit()) {
-			Node *n = *open.pop();
+			Node *n = open.pop();
+			if (this->pruned(n->f))
+				continue;
 			State buf, &state = d.unpack(buf, n->state);
 
 			if (d.isgoal(state)) {
 				solpath<D, Node>(d, n, this->res);
+				this->report((double) n->g);
 				break;
 			}
 
 			expand(d, n, state);
 		}
+		// Every node that could beat the incumbent was expanded,
+		// unless cheaper duplicates were dropped.
+		if (open.empty() && this->res.path.empty() && !dropdups)
+			this->proved();
 		this->finish();
 	}
 
@@ -103,7 +114,7 @@ template <class D> struct Wastar : public SearchAlgorithm<D> {
 	virtual void output(FILE *out) {
 		SearchAlgorithm<D>::output(out);
 		closed.prstats(stdout, "closed ");
-		dfpair(stdout, "open list type", "%s", "binary heap");
+		dfpair(stdout, "open list type", "%s", open.kind());
 		dfpair(stdout, "node size", "%u", sizeof(Node));
 		dfpair(stdout, "weight", "%lg", wt);
 	}
@@ -120,6 +131,19 @@ private:
 			SearchAlgorithm<D>::res.gend++;
 			considerkid(d, n, state, ops[i]);
 		}
+
+		// new kids wait for a batched heuristic before going on open
+		hbatch.flush(d, [this](Node *k, Cost h) { pushkid(k, h); });
+	}
+
+	void pushkid(Node *kid, Cost h) {
+		if (this->pruned(kid->f)) {
+			closed.remove(kid->state);
+			nodes->destruct(kid);
+			return;
+		}
+		kid->fprime = kid->g + wt * h;
+		open.push(kid);
 	}
 
 	void considerkid(D &d, Node *parent, State &state, Oper op) {
@@ -136,7 +160,18 @@ private:
 				nodes->destruct(kid);
 				return;
 			}
-			if (dup->openind < 0)
+			if (hbatch.pending(dup)) { // flush sets f and pushes it
+				dup->g = kid->g;
+				dup->parent = parent;
+				dup->op = op;
+				dup->pop = e.revop;
+				nodes->destruct(kid);
+				return;
+			}
+			bool isopen = open.mem(dup);
+			if (isopen)
+				open.pre_update(dup);
+			else
 				this->res.reopnd++;
 			dup->fprime = dup->fprime - dup->g + kid->g;
 			dup->f = dup->f - dup->g + kid->g;
@@ -144,17 +179,14 @@ private:
 			dup->parent = parent;
 			dup->op = op;
 			dup->pop = e.revop;
-			open.pushupdate(dup, dup->openind);
+			open.post_update(dup);
 			nodes->destruct(kid);
 		} else {
-			typename D::Cost h = d.h(e.state);
-			kid->f = kid->g + h;
-			kid->fprime = kid->g + wt * h;
 			kid->parent = parent;
 			kid->op = op;
 			kid->pop = e.revop;
 			closed.add(kid, hash);
-			open.push(kid);
+			hbatch.add(d, e.state, kid, [this](Node *k, Cost h) { pushkid(k, h); });
 		}
 	}
 
@@ -172,7 +204,8 @@ private:
 
 	bool dropdups;
 	double wt;
-	BinHeap<Node, Node*> open;
+	RadixOpenList<Node, Node, double> open;
  	ClosedList<Node, Node, D> closed;
 	Pool<Node> *nodes;
+	HeuristicBatch<D, Node> hbatch;
 };
@@ -0,0 +1,104 @@
+// Copyright © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+// MpmcQueue is a bounded lock-free queue that any number of threads
+// may push to and pop from (D. Vyukov's bounded MPMC queue).  Every
+// cell carries a sequence number that says whether it is ready to be
+// written or read in the current lap, so producers and consumers only
+// contend on their own end's counter.
+template <class Elm> class MpmcQueue {
+public:
+
+	// MpmcQueue creates a queue of sz elements rounded up to a power
+	// of two.
+	MpmcQueue(std::size_t sz = 1024) {
+		std::size_t n = 2;
+		while (n < sz)
+			n *= 2;
+		mask = n - 1;
+		cells.reset(new Cell[n]);
+		for (std::size_t i = 0; i < n; i++)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		head.pos.store(0, std::memory_order_relaxed);
+		tail.pos.store(0, std::memory_order_relaxed);
+	}
+
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue &operator=(const MpmcQueue&) = delete;
+
+	// push adds e to the back of the queue, returning false if the
+	// queue is full.
+	bool push(const Elm &e) {
+		std::size_t pos = tail.pos.load(std::memory_order_relaxed);
+		for ( ; ; ) {
+			Cell &c = cells[pos & mask];
+			std::size_t seq = c.seq.load(std::memory_order_acquire);
+			std::ptrdiff_t dif = (std::ptrdiff_t) seq - (std::ptrdiff_t) pos;
+			if (dif == 0) {
+				if (tail.pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					c.elm = e;
+					c.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = tail.pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// pop removes the front of the queue into e, returning false if
+	// the queue is empty.
+	bool pop(Elm &e) {
+		std::size_t pos = head.pos.load(std::memory_order_relaxed);
+		for ( ; ; ) {
+			Cell &c = cells[pos & mask];
+			std::size_t seq = c.seq.load(std::memory_order_acquire);
+			std::ptrdiff_t dif = (std::ptrdiff_t) seq - (std::ptrdiff_t) (pos + 1);
+			if (dif == 0) {
+				if (head.pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					e = c.elm;
+					c.seq.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = head.pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// size returns the number of queued elements.  It is only a
+	// snapshot when other threads are using the queue.
+	std::size_t size() const {
+		std::size_t t = tail.pos.load(std::memory_order_relaxed);
+		std::size_t h = head.pos.load(std::memory_order_relaxed);
+		return t > h ? t - h : 0;
+	}
+
+	std::size_t capacity() const {
+		return mask + 1;
+	}
+
+private:
+
+	struct Cell {
+		std::atomic<std::size_t> seq;
+		Elm elm;
+	};
+
+	struct alignas(64) Counter {
+		std::atomic<std::size_t> pos;
+	};
+
+	std::size_t mask;
+	std::unique_ptr<Cell[]> cells;
+	Counter head, tail;
+};
@@ -21,6 +21,8 @@ bool stn_undo_one_test();
 bool kdtree_insert_test();
 bool kdtree_nearest_test();
 bool kdtree_iterator_test();
+bool mpmcqueue_fifo_test();
+bool mpmcqueue_threads_test();
 
 static const Test tests[] = {
 	Test("htable add test", htable_add_test),
@@ -40,6 +42,8 @@ static const Test tests[] = {
 	Test("kdtree insert test", kdtree_insert_test),
 	Test("kdtree nearest test", kdtree_nearest_test),
 	Test("kdtree iterator test", kdtree_iterator_test),
+	Test("mpmcqueue fifo test", mpmcqueue_fifo_test),
+	Test("mpmcqueue threads test", mpmcqueue_threads_test),
 };
 
 enum { Ntests = sizeof(tests) / sizeof(tests[0]) };
@@ -54,6 +58,7 @@ void minmaxheap_push_bench(unsigned long, double*, double*);
 void minmaxheap_pop_bench(unsigned long, double*, double*);
 void stn_add_bench(unsigned long, double*, double*);
 void stn_undo_bench(unsigned long, double*, double*);
+void mpmcqueue_pushpop_bench(unsigned long, double*, double*);
 
 static const Benchmark benches[] = {
 	Benchmark("htable add benchmark", htable_add_bench),
@@ -66,6 +71,7 @@ static const Benchmark benches[] = {
 	Benchmark("minmaxheap pop benchmark", minmaxheap_pop_bench),
 	Benchmark("stn add benchmark", stn_add_bench),
 	Benchmark("stn undo benchmark", stn_undo_bench),
+	Benchmark("mpmcqueue push/pop benchmark", mpmcqueue_pushpop_bench),
 };
 
 enum { Nbenches = sizeof(benches) / sizeof(benches[0]) };
@@ -0,0 +1,94 @@
+// © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+
+#include "../utils/utils.hpp"
+#include "mpmcqueue.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+enum { N = 1000, Nthreads = 4 };
+
+bool mpmcqueue_fifo_test() {
+	bool res = true;
+	MpmcQueue<unsigned int> q(N);
+
+	for (unsigned int i = 0; i < q.capacity(); i++) {
+		if (!q.push(i)) {
+			testpr("Push %u failed on a queue of %lu\n", i, q.capacity());
+			res = false;
+		}
+	}
+	if (q.push(0)) {
+		testpr("Push succeeded on a full queue\n");
+		res = false;
+	}
+
+	for (unsigned int i = 0; i < q.capacity(); i++) {
+		unsigned int e;
+		if (!q.pop(e) || e != i) {
+			testpr("Expected %u from pop\n", i);
+			res = false;
+		}
+	}
+	unsigned int e;
+	if (q.pop(e)) {
+		testpr("Pop succeeded on an empty queue\n");
+		res = false;
+	}
+
+	return res;
+}
+
+// Several producers and consumers pass N values each, every value
+// must come out exactly once.
+bool mpmcqueue_threads_test() {
+	MpmcQueue<unsigned int> q(64);
+	std::vector<std::atomic<unsigned int>> seen(Nthreads * N);
+	std::atomic<unsigned int> npopped(0);
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < Nthreads; t++) {
+		threads.emplace_back([&q, t]() {
+			for (unsigned int i = 0; i < N; i++) {
+				while (!q.push(t * N + i))
+					std::this_thread::yield();
+			}
+		});
+		threads.emplace_back([&]() {
+			unsigned int e;
+			while (npopped.load() < Nthreads * N) {
+				if (!q.pop(e)) {
+					std::this_thread::yield();
+					continue;
+				}
+				seen[e]++;
+				npopped++;
+			}
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+
+	bool res = true;
+	for (unsigned int i = 0; i < Nthreads * N; i++) {
+		if (seen[i] != 1) {
+			testpr("Value %u came out %u times\n", i, seen[i].load());
+			res = false;
+		}
+	}
+	return res;
+}
+
+void mpmcqueue_pushpop_bench(unsigned long n, double *strt, double *end) {
+	MpmcQueue<unsigned long> q(1024);
+
+	*strt = walltime();
+
+	unsigned long e;
+	for (unsigned long i = 0; i < n; i++) {
+		q.push(i);
+		q.pop(e);
+	}
+
+	*end = walltime();
+}
@@ -5,40 +5,56 @@
 #include <cstdio>
 
 static SearchAlgorithm<TilesMdist> *get(int, const char *[]);
+static TilesMdist *mkdom(FILE*, int, const char *[]);
 
 int main(int argc, const char *argv[]) {
-	dfheader(stdout);
-
 	FILE *lvl = stdin;
 	const char *lvlpath = "";
-	const char *cost = "unit";
+	const char *insts = "";
 	for (int i = 0; i < argc; i++) {
 		if (i < argc - 1 && strcmp(argv[i], "-lvl") == 0)
 			lvlpath = argv[++i];
-		if(i < argc - 1 && strcmp(argv[i], "-cost") == 0)
-			cost = argv[++i];
+		if (i < argc - 1 && strcmp(argv[i], "-insts") == 0)
+			insts = argv[++i];
 	}
 
+	if (insts[0] != '\0') {
+		searchBatch<TilesMdist>(insts, mkdom, get, argc, argv);
+		return 0;
+	}
+
+	dfheader(stdout);
+
 	if (lvlpath[0] != '\0') {
 		lvl = fopen(lvlpath, "r");
 		if (!lvl)
 			fatalx(errno, "Failed to open %s for reading", lvlpath);
 	}
 
-	dfpair(stdout, "cost", "%s", cost);
-	TilesMdist d(lvl, cost);
+	TilesMdist *d = mkdom(lvl, argc, argv);
 
 	if (lvlpath[0] != '\0') {
 	  dfpair(stdout, "level", "%s", lvlpath);
 	  fclose(lvl);
 	}
 		
-	searchGet<TilesMdist>(get, d, argc, argv);
+	searchGet<TilesMdist>(get, *d, argc, argv);
+	delete d;
 	
 	dffooter(stdout);
 	return 0;
 }
 
+static TilesMdist *mkdom(FILE *lvl, int argc, const char *argv[]) {
+	const char *cost = "unit";
+	for (int i = 0; i < argc; i++) {
+		if(i < argc - 1 && strcmp(argv[i], "-cost") == 0)
+			cost = argv[++i];
+	}
+	dfpair(stdout, "cost", "%s", cost);
+	return new TilesMdist(lvl, cost);
+}
+
 static SearchAlgorithm<TilesMdist> *get(int argc, const char *argv[]) {
 	return getsearch<TilesMdist>(argc, argv);
 }
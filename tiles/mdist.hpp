@@ -130,6 +130,28 @@ public:
 	}
   
 
+	// The abstraction used by PBNF maps a state to the positions of
+	// the blank and of tile 1.
+	unsigned int nblocks() const {
+		return Ntiles * Ntiles;
+	}
+
+	unsigned int abstract(State &s) const {
+		for (unsigned int i = 0; i < Ntiles; i++) {
+			if (i != s.b && s.ts[i] == 1)
+				return s.b * Ntiles + i;
+		}
+		return s.b * Ntiles + s.b;
+	}
+
+	void abstractsuccs(unsigned int blk, std::vector<unsigned int> &succs) const {
+		Pos b = blk / Ntiles, one = blk % Ntiles;
+		for (unsigned int i = 0; i < ops[b].n; i++) {
+			Pos mv = ops[b].mvs[i];
+			succs.push_back(mv * Ntiles + (mv == one ? b : one));
+		}
+	}
+
 	Cost pathcost(const std::vector<State>&, const std::vector<Oper>&);
 
 protected:
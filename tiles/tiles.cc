@@ -8,20 +8,18 @@
 #include <ctime>
 #include <limits>
 
-bool Tiles::hashvecinit = false;
+std::once_flag Tiles::hashvecinit;
 unsigned long Tiles::hashvec[Ntiles][Ntiles];
 
 Tiles::Tiles() {
 	initops();
-	if (!hashvecinit)
-		inithashvec();
+	std::call_once(hashvecinit, inithashvec);
 }
 
 Tiles::Tiles(FILE *in) {
 	readruml(in);
 	initops();
-	if (!hashvecinit)
-		inithashvec();
+	std::call_once(hashvecinit, inithashvec);
 }
 
 void Tiles::readruml(FILE *in) {
@@ -73,7 +71,6 @@ void Tiles::initops() {
 }
 
 void Tiles::inithashvec() {
-	hashvecinit = true;
 	Rand r(time(NULL));
 	for (int i = 0; i < Ntiles; i++) {
 	for (int j = 0; j < Ntiles; j++)
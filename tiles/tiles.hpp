@@ -3,6 +3,7 @@
 
 #include <cstdio>
 #include <cassert>
+#include <mutex>
 
 class Tiles {
 public:
@@ -57,7 +58,8 @@ private:
 	void readruml(FILE*);
 	void initops();
 
-	void inithashvec();
-	static bool hashvecinit;
+	// inithashvec runs once, even with domains made by many threads.
+	static void inithashvec();
+	static std::once_flag hashvecinit;
 	static unsigned long hashvec[Ntiles][Ntiles];
 };
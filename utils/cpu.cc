@@ -0,0 +1,91 @@
+// © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+
+#include "utils.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+std::vector<unsigned int> parsecpus(const char *list) {
+	if (strcmp(list, "socket") == 0)
+		return cpusbysocket();
+
+	std::vector<unsigned int> cpus;
+	const char *p = list;
+	while (*p != '\0') {
+		char *end;
+		unsigned long lo = strtoul(p, &end, 10);
+		if (end == p)
+			fatal("Bad cpu list [%s]", list);
+		unsigned long hi = lo;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtoul(p, &end, 10);
+			if (end == p || hi < lo)
+				fatal("Bad cpu range in [%s]", list);
+		}
+		for (unsigned long c = lo; c <= hi; c++)
+			cpus.push_back(c);
+		p = end;
+		if (*p == ',')
+			p++;
+		else if (*p != '\0')
+			fatal("Bad cpu list [%s]", list);
+	}
+	return cpus;
+}
+
+int cpusocket(unsigned int cpu) {
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return -1;
+	int id = -1;
+	if (fscanf(f, "%d", &id) != 1)
+		id = -1;
+	fclose(f);
+	return id;
+}
+
+std::vector<unsigned int> cpusbysocket() {
+	std::vector<unsigned int> cpus;
+#ifdef __linux__
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
+		return cpus;
+	for (unsigned int c = 0; c < CPU_SETSIZE; c++) {
+		if (CPU_ISSET(c, &set))
+			cpus.push_back(c);
+	}
+	int cur = sched_getcpu();
+	int home = cur < 0 ? -1 : cpusocket(cur);
+	// each socket is read once, not at every comparison
+	std::vector<int> sock(cpus.empty() ? 0 : cpus.back() + 1, -1);
+	for (unsigned int c : cpus)
+		sock[c] = cpusocket(c);
+	std::stable_sort(cpus.begin(), cpus.end(), [home, &sock](unsigned int a, unsigned int b) {
+		int sa = sock[a], sb = sock[b];
+		if ((sa == home) != (sb == home))
+			return sa == home;
+		return sa < sb;
+	});
+#endif
+	return cpus;
+}
+
+bool pinthread(unsigned int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void) cpu;
+	return false;
+#endif
+}
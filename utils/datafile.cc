@@ -18,7 +18,20 @@ static void dfpair_sz(FILE*, unsigned int, const char*, const char*, va_list);
 static void machineid(FILE*);
 static void tryprocstatus(FILE*);
 
+// redirect is where the calling thread's standard output datafile
+// lines go instead, if it is not NULL.
+static thread_local FILE *redirect = NULL;
+
+static FILE *dest(FILE *f) {
+	return f == stdout && redirect ? redirect : f;
+}
+
+void dfredirect(FILE *f) {
+	redirect = f;
+}
+
 void dfpair(FILE *f, const char *key, const char *fmt, ...) {
+	f = dest(f);
 	char buf[Bufsz];
 	int n = snprintf(buf, Bufsz, "#pair  \"%s\"\t\"", key);
 	if (n > Bufsz)
@@ -52,6 +65,7 @@ static void dfpair_sz(FILE *f, unsigned int sz, const char *key, const char *fmt
 }
 
 void dfrowhdr(FILE *f, const char *name, unsigned int ncols, ...) {
+	f = dest(f);
 	char buf[Bufsz];
 	int n = snprintf(buf, Bufsz, "#altcols  \"%s\"", name);
 	if (n > Bufsz)
@@ -72,6 +86,7 @@ void dfrowhdr(FILE *f, const char *name, unsigned int ncols, ...) {
 }
 
 void dfrow(FILE *f, const char *name, const char *colfmt, ...) {
+	f = dest(f);
 	char buf[Bufsz];
 	int n = snprintf(buf, Bufsz, "#altrow  \"%s\"", name);
 	if (n > Bufsz)
@@ -113,6 +128,7 @@ void dfrow(FILE *f, const char *name, const char *colfmt, ...) {
 }
 
 void dfheader(FILE *f) {
+	f = dest(f);
 	fputs(start4, f);
 
 	time_t tm;
@@ -126,6 +142,7 @@ void dfheader(FILE *f) {
 }
 
 void dffooter(FILE *f) {
+	f = dest(f);
 	dfpair(f, "wall finish time", "%g", walltime());
 
 	time_t tm;
@@ -138,6 +155,7 @@ void dffooter(FILE *f) {
 }
 
 void dfprocstatus(FILE *f) {
+	f = dest(f);
 	tryprocstatus(f);
 }
 
@@ -2,7 +2,10 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <new>
 
 template <class Obj> class Pool {
 public:
@@ -71,3 +74,109 @@ private:
 	int blk;
 	std::vector<Ent*> blks;
 };
+
+// PoolIdx is an index into an IdxPool.  Index 0 is never handed out
+// so it can stand for NULL.
+typedef uint32_t PoolIdx;
+
+// An IdxPool is a Pool that can also name its objects by a 32-bit
+// index, so that objects can refer to each other in half the space
+// of a pointer.  The objects are kept in blocks of Blkbytes bytes that
+// are aligned to their size.  The first bytes of a block hold its
+// number, so the index of an object is found from its address.
+template <class Obj> class IdxPool {
+public:
+
+	IdxPool() : nxt(1), freed(0) {
+		newblk();
+	}
+
+	~IdxPool() {
+		for (unsigned int i = 0; i < blks.size(); i++)
+			free(blks[i]);
+	}
+
+	Obj *get() {
+		if (freed) {
+			Ent *res = ent(freed);
+			freed = res->nxt;
+			return (Obj*) res->bytes;
+		}
+
+		if (nxt % Perblk == 0)
+			newblk();
+
+		return (*this)[nxt++];
+	}
+
+	void put(Obj *o) {
+		Ent *e = (Ent*) o;
+		PoolIdx i = index(o);
+		e->nxt = freed;
+		freed = i;
+	}
+
+	Obj *construct() {
+		Obj *o = get();
+		return new (o) Obj();
+	}
+
+	void destruct(Obj *o) {
+		o->~Obj();
+		put(o);
+	}
+
+	// index returns the index of an object from this pool.
+	PoolIdx index(const Obj *o) const {
+		uintptr_t p = (uintptr_t) o;
+		const Blk *b = (const Blk*) (p & ~(uintptr_t) (Blkbytes - 1));
+		return b->num * Perblk + (p - (uintptr_t) b->ents) / sizeof(Ent);
+	}
+
+	// operator[] returns the object with the given index, or NULL
+	// for index 0.
+	Obj *operator[](PoolIdx i) const {
+		if (i == 0)
+			return NULL;
+		return (Obj*) ent(i)->bytes;
+	}
+
+	// Blocks returns the number of allocated blocks.
+	unsigned long blocks() const {
+		return blks.size();
+	}
+
+private:
+
+	union Ent {
+		alignas(Obj) char bytes[sizeof(Obj)];
+		PoolIdx nxt;
+	};
+
+	enum { Blkbytes = 1 << 21 };
+
+	struct Blk {
+		unsigned long num;
+		alignas(64) Ent ents[1];
+	};
+
+	static constexpr unsigned long Perblk = (Blkbytes - offsetof(Blk, ents)) / sizeof(Ent);
+	static_assert(Perblk > 1, "pool objects are too big for a block");
+
+	Ent *ent(PoolIdx i) const {
+		return blks[i / Perblk]->ents + i % Perblk;
+	}
+
+	void newblk() {
+		if ((blks.size() + 1) * Perblk > (1ul << 32))
+			throw std::bad_alloc();
+		Blk *b = (Blk*) aligned_alloc(Blkbytes, Blkbytes);
+		if (!b)
+			throw std::bad_alloc();
+		b->num = blks.size();
+		blks.push_back(b);
+	}
+
+	PoolIdx nxt, freed;
+	std::vector<Blk*> blks;
+};
@@ -22,6 +22,9 @@ bool test_base64dec();
 bool test_encdec();
 bool test_basename();
 bool test_dirname();
+bool test_parsecpus();
+bool test_dfredirect();
+bool test_idxpool();
 
 static const Test tests[] = {
 	Test("commas test", test_commas),
@@ -44,6 +47,9 @@ static const Test tests[] = {
 	Test("encode/decode test", test_encdec),
 	Test("basename test", test_basename),
 	Test("dirname test", test_dirname),
+	Test("parsecpus test", test_parsecpus),
+	Test("dfredirect test", test_dfredirect),
+	Test("idxpool test", test_idxpool),
 };
 
 enum { Ntests = sizeof(tests) / sizeof(tests[0]) };
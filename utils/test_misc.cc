@@ -1,6 +1,8 @@
 // © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
 
 #include "../utils/utils.hpp"
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 
 bool test_commas() {
@@ -36,4 +38,45 @@ bool test_commas() {
 	}
 
 	return ok;
-}
\ No newline at end of file
+}
+
+bool test_parsecpus() {
+	struct { const char *list; std::vector<unsigned int> cpus; } tsts[] = {
+		{ "3", { 3 } },
+		{ "0,2", { 0, 2 } },
+		{ "4-7", { 4, 5, 6, 7 } },
+		{ "1,3-4,0", { 1, 3, 4, 0 } },
+	};
+
+	bool ok = true;
+	for (unsigned int i = 0; i < sizeof(tsts)/sizeof(tsts[0]); i++) {
+		std::vector<unsigned int> cpus = parsecpus(tsts[i].list);
+		if (cpus == tsts[i].cpus)
+			continue;
+		testpr("parsecpus(\"%s\") gave %lu cpus\n", tsts[i].list, cpus.size());
+		ok = false;
+	}
+
+	return ok;
+}
+
+bool test_dfredirect() {
+	char *buf = NULL;
+	size_t sz = 0;
+	FILE *mem = open_memstream(&buf, &sz);
+	if (!mem)
+		fatalx(errno, "open_memstream failed");
+
+	dfredirect(mem);
+	dfpair(stdout, "redirected", "%d", 1);
+	dfredirect(NULL);
+	fclose(mem);
+
+	bool ok = true;
+	if (!buf || strcmp(buf, "#pair  \"redirected\"\t\"1\"\n") != 0) {
+		testpr("expected the pair in the buffer, got [%s]\n", buf ? buf : "");
+		ok = false;
+	}
+	free(buf);
+	return ok;
+}
@@ -0,0 +1,59 @@
+// © 2013 the Search Authors under the MIT license. See AUTHORS for the list of authors.
+
+#include "utils.hpp"
+#include "pool.hpp"
+#include <vector>
+
+struct Obj {
+	unsigned long vl;
+	PoolIdx link;
+};
+
+enum { N = 200000 };
+
+// Fills several blocks, then checks that every object's index leads
+// back to it and that freed indices are handed out again.
+bool test_idxpool() {
+	bool res = true;
+	IdxPool<Obj> pool;
+	std::vector<Obj*> objs;
+
+	if (pool[0] != NULL) {
+		testpr("Index 0 is not NULL\n");
+		res = false;
+	}
+
+	for (unsigned long i = 0; i < N; i++) {
+		Obj *o = pool.construct();
+		o->vl = i;
+		o->link = i == 0 ? 0 : pool.index(objs.back());
+		objs.push_back(o);
+	}
+	if (pool.blocks() < 2) {
+		testpr("%u objects fit in one block\n", N);
+		res = false;
+	}
+
+	for (unsigned long i = 0; i < N; i++) {
+		PoolIdx ind = pool.index(objs[i]);
+		if (ind == 0 || pool[ind] != objs[i]) {
+			testpr("Object %lu has index %u\n", i, ind);
+			return false;
+		}
+		Obj *prev = pool[objs[i]->link];
+		if (i > 0 && (!prev || prev->vl != i - 1)) {
+			testpr("Object %lu does not link to object %lu\n", i, i - 1);
+			return false;
+		}
+	}
+
+	PoolIdx freed = pool.index(objs[N / 2]);
+	pool.destruct(objs[N / 2]);
+	Obj *o = pool.construct();
+	if (pool.index(o) != freed) {
+		testpr("Got index %u after freeing %u\n", pool.index(o), freed);
+		res = false;
+	}
+
+	return res;
+}
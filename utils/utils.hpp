@@ -126,6 +126,12 @@ void dffooter(FILE *);
 // if the proc/ filesystem is readable.
 void dfprocstatus(FILE*);
 
+// dfredirect sends the datafile output that the calling thread
+// writes to standard output to the given file instead, or back to
+// standard output if the file is NULL.  It lets threads that run
+// separate searches each write a whole datafile.
+void dfredirect(FILE*);
+
 typedef void(*Dfhandler)(std::vector<std::string>&, void*);
 
 // dfread reads #pair, #altcols and #altrow lines from the
@@ -181,6 +187,23 @@ void testpr(const char *fmt, ...);
 // with the %g or %e forms of floats or doubles.
 std::string commas(const char *fmt, ...);
 
+// parsecpus parses a list of cpus like "0,2,4-7".  The list
+// "socket" is all of the cpus the process may run on, see
+// cpusbysocket.  A malformed list is fatal.
+std::vector<unsigned int> parsecpus(const char*);
+
+// cpusocket returns the physical package of the given cpu or -1
+// if it is unknown.
+int cpusocket(unsigned int);
+
+// cpusbysocket returns the cpus the process may run on, those on
+// the calling thread's socket first.
+std::vector<unsigned int> cpusbysocket();
+
+// pinthread binds the calling thread to the given cpu, returning
+// false if it cannot.
+bool pinthread(unsigned int);
+
 // hashbytes computes a hash on an arbitrary array of bytes.
 // The hash function is by Bob Jenkins (2006) and the resulting
 // hash value is 32-bits.